@@ -0,0 +1,140 @@
+/**
+ * Allocation-counting test for the external scanner.
+ *
+ * Replays scan/serialize/deserialize cycles at every position of the input, the way the runtime calls the scanner, and
+ * fails if any of them allocate while the layout stack fits into its inline storage.
+ *
+ * The counts come from overriding tree-sitter's allocator hooks. With `-DUNISON_SCANNER_ALLOC_STATS` the scanner's own
+ * accounting is reported as well and checked against them, both that of the scanner and that of the process.
+ *
+ * cc -O2 -Isrc -Ibench [-DUNISON_SCANNER_ALLOC_STATS] bench/allocations.c -o allocations && ./allocations [unison-file]
+ */
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned long allocations;
+
+static void *counting_malloc(size_t size) {
+  allocations++;
+  return malloc(size);
+}
+
+static void *counting_calloc(size_t count, size_t size) {
+  allocations++;
+  return calloc(count, size);
+}
+
+static void *counting_realloc(void *ptr, size_t size) {
+  allocations++;
+  return realloc(ptr, size);
+}
+
+#define ts_malloc counting_malloc
+#define ts_calloc counting_calloc
+#define ts_realloc counting_realloc
+#define ts_free free
+#include "scanner.c"
+
+#include "mock_lexer.h"
+
+static const char *default_input =
+  "foo : Nat -> Nat\n"
+  "foo n =\n"
+  "  use Nat +\n"
+  "  go acc = cases\n"
+  "    0 -> acc\n"
+  "    k | k > 10 -> go (acc + k) (k - 1)\n"
+  "    k -> let\n"
+  "      x = handle bar k with h\n"
+  "      if x > 2 then x else go acc (k - 1)\n"
+  "  {{ A doc {{ nested }} }}\n"
+  "  go 0 n {- comment -} |> (x -> x ++ [1, 2, 3])\n";
+
+/**
+ * Valid-symbol sets of the kind the parse tables produce.
+ */
+static void symbols(bool *syms, unsigned variant) {
+  memset(syms, 0, sizeof(bool) * (FAIL + 1));
+  switch (variant % 4) {
+    case 0: syms[START] = true; break;
+    case 1: syms[SEMICOLON] = syms[END] = syms[COMMENT] = true; break;
+    case 2: syms[SYMOP] = syms[IN] = syms[WHERE] = syms[DOC_OPEN] = true; break;
+    case 3: syms[GUARD_LAYOUT_START] = syms[START] = syms[FOLD] = syms[OCTOTHORPE] = syms[DOT] = true; break;
+  }
+}
+
+/**
+ * Scan from every position, with the layout state the runtime would restore there: a stack of `base_depth` to
+ * `base_depth + 7` layouts, passed in through a serialization buffer.
+ * Returns the number of allocations made after creating the scanner.
+ */
+static unsigned long replay(const int32_t *input, uint32_t length, unsigned base_depth) {
+  MockLexer m;
+  mock_lexer_init(&m, input, length);
+  indent_vec *builder = tree_sitter_unison_external_scanner_create();
+  char buffers[8][TREE_SITTER_SERIALIZATION_BUFFER_SIZE];
+  unsigned lengths[8];
+  for (unsigned d = 0; d < 8; d++) {
+    builder->len = 0;
+    for (unsigned i = 0; i < base_depth + d; i++) {
+      VEC_PUSH(builder, 2 * i);
+    }
+    lengths[d] = tree_sitter_unison_external_scanner_serialize(builder, buffers[d]);
+  }
+  tree_sitter_unison_external_scanner_destroy(builder);
+  void *scanner = tree_sitter_unison_external_scanner_create();
+  char out[TREE_SITTER_SERIALIZATION_BUFFER_SIZE];
+  bool syms[FAIL + 1];
+  allocations = 0;
+  for (uint32_t position = 0; position < length; position++) {
+    symbols(syms, position);
+    tree_sitter_unison_external_scanner_deserialize(scanner, buffers[position % 8], lengths[position % 8]);
+    mock_lexer_seek(&m, position);
+    if (tree_sitter_unison_external_scanner_scan(scanner, &m.lexer, syms)) {
+      tree_sitter_unison_external_scanner_serialize(scanner, out);
+    }
+  }
+  unsigned long result = allocations;
+#ifdef UNISON_SCANNER_ALLOC_STATS
+  TreeSitterUnisonAllocations own = tree_sitter_unison_external_scanner_allocations(scanner);
+  TreeSitterUnisonAllocations process = tree_sitter_unison_scanner_allocations();
+  printf("  scanner accounting: %lu calls, %lu bytes held, %lu bytes peak\n",
+    (unsigned long) own.calls, (unsigned long) own.bytes, (unsigned long) own.peak);
+  // `calls` includes creating the scanner, which happened before the count was reset.
+  if (own.calls != result + 1) {
+    printf("FAIL: scanner accounting disagrees with the allocator hooks (%lu vs %lu)\n",
+      (unsigned long) own.calls - 1, result);
+    result = (unsigned long) -1;
+  }
+  // The builder is gone, so the scanner holds all the memory of the process.
+  if (process.bytes != own.bytes) {
+    printf("FAIL: the process holds %lu bytes, the only scanner %lu\n", (unsigned long) process.bytes,
+      (unsigned long) own.bytes);
+    result = (unsigned long) -1;
+  }
+#endif
+  tree_sitter_unison_external_scanner_destroy(scanner);
+#ifdef UNISON_SCANNER_ALLOC_STATS
+  if (tree_sitter_unison_scanner_allocations().bytes != 0) {
+    printf("FAIL: %lu bytes left after destroying all scanners\n",
+      (unsigned long) tree_sitter_unison_scanner_allocations().bytes);
+    result = (unsigned long) -1;
+  }
+#endif
+  return result;
+}
+
+int main(int argc, char **argv) {
+  uint32_t length;
+  int32_t *input = argc > 1
+    ? mock_read_file(argv[1], &length)
+    : mock_decode_utf8(default_input, strlen(default_input), &length);
+
+  unsigned long common = replay(input, length, 0);
+  printf("%u scans with shallow nesting: %lu allocations\n", length, common);
+  unsigned long deep = replay(input, length, INDENT_INLINE_CAPACITY);
+  printf("%u scans nested %u layouts deep: %lu allocations\n", length, INDENT_INLINE_CAPACITY, deep);
+
+  free(input);
+  return common == 0 ? 0 : 1;
+}
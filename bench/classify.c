@@ -0,0 +1,120 @@
+/**
+ * Microbenchmark for the scanner's character classification.
+ *
+ * Compares the switch-based predicates the scanner used to have with the class table in `src/scanner.c`, on
+ * operator-dense and emoji-identifier-dense input.
+ *
+ * cc -O2 -Isrc bench/classify.c -o classify && ./classify
+ */
+#include "scanner.c"
+#include <ctype.h>
+#include <time.h>
+
+#define INPUT_LEN (1 << 20)
+#define ROUNDS 50
+
+// --------------------------------------------------------------------------------------------------------
+// Switch-based classifiers, as they were before the class table
+// --------------------------------------------------------------------------------------------------------
+
+#define OLD_WS_CASES \
+  case ' ': \
+  case '\f': \
+  case '\n': \
+  case '\r': \
+  case '\t': \
+  case '\v'
+
+static bool old_isws(uint32_t c) {
+  switch (c) {
+    OLD_WS_CASES: return true;
+    default: return false;
+  }
+}
+
+static bool old_token_end(uint32_t c) {
+  switch (c) {
+    OLD_WS_CASES:
+    case 0:
+    case '(':
+    case ')':
+    case '[':
+    case ']':
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool old_is_newline(uint32_t c) {
+  switch (c) {
+    NEWLINE_CASES:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool old_symbolic(uint32_t c) {
+  switch (c) {
+    case '$': case '%': case '^': case '&': case '*': case '-': case '=': case '+': case '<': case '>': case '.':
+    case '~': case '\\': case '/': case ':': case '!': case '|':
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Only defined for code points up to 255, which is exactly the problem.
+static bool old_is_alnum(uint32_t c) { return c <= 255 && (isdigit(c) || isalpha(c)); }
+
+// --------------------------------------------------------------------------------------------------------
+// Harness
+// --------------------------------------------------------------------------------------------------------
+
+static void fill(int32_t *buf, const int32_t *pattern, size_t n) {
+  for (size_t i = 0; i < INPUT_LEN; i++) buf[i] = pattern[i % n];
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#define RUN(name, input, isws_, token_end_, is_newline_, symbolic_, is_alnum_) do { \
+  unsigned sum = 0; \
+  double start = now_ns(); \
+  for (int r = 0; r < ROUNDS; r++) { \
+    for (size_t i = 0; i < INPUT_LEN; i++) { \
+      int32_t c = (input)[i]; \
+      sum += isws_(c) + token_end_(c) + is_newline_(c) + symbolic_(c) + is_alnum_(c); \
+    } \
+  } \
+  double ns = (now_ns() - start) / ((double) ROUNDS * INPUT_LEN); \
+  printf("%-10s %-8s %6.3f ns/char (checksum %u)\n", #input, name, ns, sum); \
+} while (0)
+
+int main(void) {
+  static const int32_t operators_pattern[] = {
+    'x', ' ', '<', '|', '>', ' ', 'y', ' ', '>', '>', '=', ' ', '(', 'z', ' ', '+', '+', '+', ' ', 'w', ')', ' ',
+    '&', '&', ' ', '!', 'v', ' ', '|', '|', ' ', '-', '>', '\n', ' ', ' ', '~', '/', '\\', ':', '%', '^', '$',
+  };
+  static const int32_t emoji_pattern[] = {
+    0x1f419, 0x1f980, '_', 'a', 0x1f600, '\'', ' ', '=', ' ', 0x1f436, 0x1f431, '!', ' ', '+', ' ', 0x1fa90,
+    0x1f525, 0x1f4a9, 'b', '2', '\n', 0x00e9, 0x03bb, ' ', 0x2200,
+  };
+  int32_t *operators = malloc(sizeof(int32_t) * INPUT_LEN);
+  int32_t *emoji = malloc(sizeof(int32_t) * INPUT_LEN);
+  fill(operators, operators_pattern, sizeof(operators_pattern) / sizeof(operators_pattern[0]));
+  fill(emoji, emoji_pattern, sizeof(emoji_pattern) / sizeof(emoji_pattern[0]));
+
+  RUN("switch", operators, old_isws, old_token_end, old_is_newline, old_symbolic, old_is_alnum);
+  RUN("table", operators, isws, token_end, is_newline, symbolic, is_alnum);
+  RUN("switch", emoji, old_isws, old_token_end, old_is_newline, old_symbolic, old_is_alnum);
+  RUN("table", emoji, isws, token_end, is_newline, symbolic, is_alnum);
+
+  free(operators);
+  free(emoji);
+  return 0;
+}
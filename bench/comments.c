@@ -0,0 +1,196 @@
+/**
+ * Pathological multiline comments.
+ *
+ * Scans comments the way the runtime does, passing the scanner state from one token to the next through a
+ * serialization buffer, and fails if any of them
+ *
+ *   - doesn't end where it should: a 10 MB comment, nesting far beyond 16 bits of depth, an unterminated comment
+ *   - makes a single call scan more than a bounded number of characters
+ *
+ * It also replays edits in the 10 MB comment and reports how much of it is re-lexed, compared with a single token.
+ *
+ * cc -O2 -Isrc -Ibench bench/comments.c -o comments && ./comments
+ */
+#include "scanner.c"
+#include "mock_lexer.h"
+#include <string.h>
+#include <time.h>
+
+#define EDITS 50
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t rng = 0x9e3779b97f4a7c15u;
+
+static uint32_t next_random(uint32_t bound) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng % bound;
+}
+
+typedef struct {
+  int32_t *data;
+  uint32_t len;
+} Text;
+
+static void append(Text *t, const char *s) {
+  while (*s) t->data[t->len++] = *s++;
+}
+
+/**
+ * A single token scans at most one chunk, whose last step may take two characters.
+ */
+static const unsigned long max_advances = COMMENT_CHUNK_MAX + 2;
+
+typedef struct {
+  uint32_t tokens;
+  uint32_t end;
+  unsigned long max_advances;
+  double ns;
+} Scanned;
+
+/**
+ * Scan the comment at `start` up to its end, from one token to the next, recording where each token ends and the
+ * state it leaves behind.
+ */
+static Scanned scan_comment_at(MockLexer *m, uint32_t start, uint32_t *ends, uint32_t *depths) {
+  void *scanner = tree_sitter_unison_external_scanner_create();
+  char buffer[TREE_SITTER_SERIALIZATION_BUFFER_SIZE];
+  unsigned length = 0;
+  bool syms[FAIL + 1] = {false};
+  syms[COMMENT] = true;
+  Scanned result = {0};
+  uint32_t position = start;
+  double begin = now_ns();
+  do {
+    tree_sitter_unison_external_scanner_deserialize(scanner, buffer, length);
+    mock_lexer_seek(m, position);
+    m->advances = 0;
+    if (!tree_sitter_unison_external_scanner_scan(scanner, &m->lexer, syms) || m->lexer.result_symbol != COMMENT) break;
+    length = tree_sitter_unison_external_scanner_serialize(scanner, buffer);
+    position = mock_lexer_token_end(m);
+    if (ends != NULL) ends[result.tokens] = position;
+    if (depths != NULL) depths[result.tokens] = ((indent_vec *) scanner)->comment_depth;
+    result.tokens++;
+    result.max_advances = MAX(result.max_advances, m->advances);
+  } while (((indent_vec *) scanner)->comment_depth > 0);
+  result.ns = now_ns() - begin;
+  result.end = position;
+  tree_sitter_unison_external_scanner_destroy(scanner);
+  return result;
+}
+
+static bool check(const char *name, Text *t, uint32_t expected_end) {
+  MockLexer m;
+  mock_lexer_init(&m, t->data, t->len);
+  Scanned s = scan_comment_at(&m, 0, NULL, NULL);
+  bool ok = s.end == expected_end && s.max_advances <= max_advances;
+  printf("%-5s %-44s %9u characters, %5u tokens, at most %5lu per call, %7.2f ms\n", ok ? "ok" : "FAIL", name, t->len,
+    s.tokens, s.max_advances, s.ns / 1e6);
+  return ok;
+}
+
+/**
+ * Insert a few characters at random positions in the comment, and re-lex it from the token that contains
+ * the edit until a token ends where one ended before, with the same state.
+ */
+static void replay(Text *t) {
+  uint32_t capacity = t->len + 16 * EDITS;
+  uint32_t *ends = malloc(sizeof(uint32_t) * capacity), *depths = malloc(sizeof(uint32_t) * capacity);
+  uint32_t *new_ends = malloc(sizeof(uint32_t) * capacity), *new_depths = malloc(sizeof(uint32_t) * capacity);
+  MockLexer m;
+  mock_lexer_init(&m, t->data, t->len);
+  uint32_t tokens = scan_comment_at(&m, 0, ends, depths).tokens;
+  unsigned long scanned = 0, edits = 0;
+  while (edits < EDITS) {
+    // Typing right after a `{` or `-` could open or close a comment, which is an edit of the structure, not the text.
+    uint32_t at = 2 + next_random(t->len - 4);
+    if (t->data[at - 1] == '{' || t->data[at - 1] == '-') continue;
+    edits++;
+    uint32_t inserted = next_random(6);
+    memmove(t->data + at + inserted, t->data + at, sizeof(int32_t) * (t->len - at));
+    for (uint32_t i = 0; i < inserted; i++) t->data[at + i] = next_random(8) == 0 ? '\n' : 'a' + next_random(26);
+    t->len += inserted;
+
+    uint32_t k = 0;
+    while (k < tokens && ends[k] < at) k++;
+    uint32_t start = k == 0 ? 0 : ends[k - 1];
+    uint32_t old = k;
+    mock_lexer_init(&m, t->data, t->len);
+    // Continue from the state the previous token left behind.
+    indent_vec *scanner = tree_sitter_unison_external_scanner_create();
+    bool syms[FAIL + 1] = {false};
+    syms[COMMENT] = true;
+    uint32_t position = start, depth = k == 0 ? 0 : depths[k - 1];
+    do {
+      scanner->comment_depth = depth;
+      mock_lexer_seek(&m, position);
+      tree_sitter_unison_external_scanner_scan(scanner, &m.lexer, syms);
+      position = mock_lexer_token_end(&m);
+      depth = scanner->comment_depth;
+      while (old < tokens && ends[old] + inserted < position) old++;
+    } while (depth > 0 && !(old < tokens && ends[old] + inserted == position && depths[old] == depth));
+    scanned += m.advances;
+    tree_sitter_unison_external_scanner_destroy(scanner);
+
+    tokens = scan_comment_at(&m, 0, new_ends, new_depths).tokens;
+    uint32_t *swap = ends;
+    ends = new_ends;
+    new_ends = swap;
+    swap = depths;
+    depths = new_depths;
+    new_depths = swap;
+  }
+  printf("edits: %.0f characters re-lexed per edit, instead of %u for a single token\n", (double) scanned / edits,
+    t->len);
+  free(ends);
+  free(depths);
+  free(new_ends);
+  free(new_depths);
+}
+
+int main(void) {
+  static const char *words[] = {"lorem ", "ipsum ", "{- nested -} ", "x = 5 ", "-- ", "{ } ", "- ", "\n", "\n  "};
+  Text t = {malloc(sizeof(int32_t) * (12 << 20)), 0};
+  bool ok = true;
+
+  append(&t, "{-");
+  while (t.len < 10 << 20) append(&t, words[next_random(sizeof(words) / sizeof(words[0]))]);
+  append(&t, "-}");
+  uint32_t end = t.len;
+  append(&t, "\nx = 5\n");
+  ok &= check("10 MB comment", &t, end);
+
+  t.len = end - 2;
+  ok &= check("10 MB unterminated comment", &t, t.len);
+
+  t.len = 0;
+  for (uint32_t i = 0; i < 70000; i++) append(&t, "{-");
+  for (uint32_t i = 0; i < 70000; i++) append(&t, "-}");
+  end = t.len;
+  append(&t, " -} x");
+  ok &= check("nested 70000 deep", &t, end);
+
+  t.len = 0;
+  for (uint32_t i = 0; i < 2000000; i++) append(&t, i % 64 == 63 ? "{-\n" : "{-");
+  for (uint32_t i = 0; i < 2000000; i++) append(&t, i % 64 == 63 ? "-}\n" : "-}");
+  ok &= check("nested 2000000 deep", &t, t.len - 1);
+
+  t.len = 0;
+  for (uint32_t i = 0; i < 200000; i++) append(&t, "{- ");
+  ok &= check("200000 unterminated", &t, t.len);
+
+  t.len = 0;
+  append(&t, "{-");
+  while (t.len < 10 << 20) append(&t, words[next_random(sizeof(words) / sizeof(words[0]))]);
+  append(&t, "-}");
+  replay(&t);
+
+  free(t.data);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+/**
+ * Per-keystroke re-lexing cost in a long doc block.
+ *
+ * Builds a doc block of 2000 lines with prose, fenced code, directives and nested blocks, and types single characters
+ * at random positions in it. After each keystroke, the doc block is re-lexed the way incremental parsing does it: from
+ * the start of the token that contains the edit, until a token ends where one ended before the keystroke. That is
+ * compared with the old scanner, which produced the whole doc block as one token and had to scan all of it again.
+ *
+ * cc -O2 -Isrc -Ibench bench/doc.c -o doc && ./doc
+ */
+#include "scanner.c"
+#include "mock_lexer.h"
+#include <string.h>
+#include <time.h>
+
+#define LINES 2000
+#define KEYSTROKES 2000
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t rng = 0x9e3779b97f4a7c15u;
+
+static uint32_t next_random(uint32_t bound) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng % bound;
+}
+
+static const char *lines[] = {
+  "  `repeat` is a function which will repeat the provided text a specified number of times.",
+  "",
+  "  Source:",
+  "  @source{repeat}",
+  "  ```",
+  "  (repeat 2 \"rose is a \") ++ \"rose\"",
+  "  ```",
+  "  See {{ a nested doc }} and {Some.Link} for more.",
+  "  @signature{repeat}, @eval{repeat 3 \"x\"}",
+};
+
+// --------------------------------------------------------------------------------------------------------
+// Doc block scan, as it was before doc blocks were split into lines
+// --------------------------------------------------------------------------------------------------------
+
+static uint32_t old_doc_block(MockLexer *m, uint32_t open) {
+  mock_lexer_seek(m, open + 2);
+  TSLexer *lexer = &m->lexer;
+  uint16_t level = 1;
+  while (!lexer->eof(lexer) && level > 0) {
+    int32_t c = lexer->lookahead;
+    lexer->advance(lexer, false);
+    if ((c == '{' || c == '}') && !lexer->eof(lexer) && lexer->lookahead == c) level += c == '{' ? 1 : -1;
+    if (c == '{' || c == '}') lexer->advance(lexer, false);
+  }
+  return m->position;
+}
+
+// --------------------------------------------------------------------------------------------------------
+// Harness
+// --------------------------------------------------------------------------------------------------------
+
+/**
+ * Scan the token of a doc block at `position`, and return where it ends.
+ */
+static uint32_t scan_token(void *scanner, MockLexer *m, uint32_t position) {
+  bool syms[FAIL + 1] = {false};
+  syms[COMMENT] = syms[DOC_OPEN] = syms[DOC_CLOSE] = syms[DOC_TEXT] = true;
+  tree_sitter_unison_external_scanner_deserialize(scanner, NULL, 0);
+  mock_lexer_seek(m, position);
+  if (!tree_sitter_unison_external_scanner_scan(scanner, &m->lexer, syms)) {
+    fprintf(stderr, "no doc token at %u\n", position);
+    exit(1);
+  }
+  return mock_lexer_token_end(m);
+}
+
+/**
+ * Tokenize the contents of the doc block that starts at 0, writing the end of each token to `ends`. Returns the
+ * number of tokens.
+ */
+static uint32_t tokenize(void *scanner, MockLexer *m, uint32_t *ends) {
+  uint32_t n = 0;
+  for (uint32_t position = 2; position < m->length; n++) {
+    position = ends[n] = scan_token(scanner, m, position);
+  }
+  return n;
+}
+
+int main(void) {
+  uint32_t capacity = 8 + LINES * 128 + KEYSTROKES;
+  int32_t *input = malloc(sizeof(int32_t) * capacity);
+  int32_t *edited = malloc(sizeof(int32_t) * capacity);
+  uint32_t length = 0;
+  input[length++] = '{';
+  input[length++] = '{';
+  for (int l = 0; l < LINES; l++) {
+    input[length++] = '\n';
+    for (const char *c = lines[next_random(sizeof(lines) / sizeof(lines[0]))]; *c; c++) input[length++] = *c;
+  }
+  input[length++] = '\n';
+  input[length++] = '}';
+  input[length++] = '}';
+
+  void *scanner = tree_sitter_unison_external_scanner_create();
+  MockLexer m;
+  mock_lexer_init(&m, input, length);
+  uint32_t *ends = malloc(sizeof(uint32_t) * capacity);
+  uint32_t tokens = tokenize(scanner, &m, ends);
+  printf("doc block of %u characters in %u tokens\n", length, tokens);
+
+  unsigned long scanned = 0, whole = 0;
+  double chunked_ns = 0, whole_ns = 0;
+  for (int k = 0; k < KEYSTROKES; k++) {
+    static const char typed[] = "abcdefghijklmnopqrstuvwxyz    \n";
+    // Typing right after a brace could pair it up with another one, which is an edit of the structure, not the text.
+    uint32_t at;
+    do {
+      at = 2 + next_random(length - 4);
+    } while (input[at - 1] == '{' || input[at - 1] == '}');
+    memcpy(edited, input, sizeof(int32_t) * at);
+    edited[at] = typed[next_random(sizeof(typed) - 1)];
+    memcpy(edited + at + 1, input + at, sizeof(int32_t) * (length - at));
+    uint32_t edited_length = length + 1;
+
+    // The first token that overlaps the keystroke, and the first old token end that is past it.
+    uint32_t t = 0;
+    while (t < tokens && ends[t] < at) t++;
+    uint32_t start = t == 0 ? 2 : ends[t - 1];
+    uint32_t old = t;
+    while (old < tokens && ends[old] <= at) old++;
+
+    mock_lexer_init(&m, edited, edited_length);
+    double begin = now_ns();
+    uint32_t position = start;
+    do {
+      position = scan_token(scanner, &m, position);
+      while (old < tokens && ends[old] + 1 < position) old++;
+    } while (position < edited_length && !(old < tokens && ends[old] + 1 == position));
+    chunked_ns += now_ns() - begin;
+    scanned += m.advances;
+
+    m.advances = 0;
+    begin = now_ns();
+    uint32_t end = old_doc_block(&m, 0);
+    whole_ns += now_ns() - begin;
+    whole += m.advances;
+    if (end != edited_length) {
+      fprintf(stderr, "FAIL: the doc block ends at %u instead of %u\n", end, edited_length);
+      return 1;
+    }
+
+    int32_t *swap = input;
+    input = edited;
+    edited = swap;
+    length = edited_length;
+    mock_lexer_init(&m, input, length);
+    tokens = tokenize(scanner, &m, ends);
+
+    // The tokens after the point where re-lexing stopped must be the ones a full scan of the edited block produces.
+    uint32_t i = 0;
+    while (i < tokens && ends[i] < position) i++;
+    if (i == tokens || ends[i] != position) {
+      fprintf(stderr, "FAIL: re-lexing stopped at %u, which is not a token boundary\n", position);
+      return 1;
+    }
+  }
+
+  printf("line tokens:  %7.0f characters re-scanned per keystroke, %7.2f us\n", (double) scanned / KEYSTROKES,
+    chunked_ns / KEYSTROKES / 1e3);
+  printf("single token: %7.0f characters re-scanned per keystroke, %7.2f us\n", (double) whole / KEYSTROKES,
+    whole_ns / KEYSTROKES / 1e3);
+
+  tree_sitter_unison_external_scanner_destroy(scanner);
+  free(ends);
+  free(edited);
+  free(input);
+  return 0;
+}
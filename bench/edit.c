@@ -0,0 +1,380 @@
+/**
+ * Latency of incremental reparses while typing, like an editor reparses after every keystroke.
+ *
+ * Replays edit scripts one keystroke at a time, each as a `ts_tree_edit` of the last tree followed by a reparse with
+ * it, and reports the p50, p95 and p99 latency per kind of script and overall. The scripts are synthesized from the
+ * input, and each one undoes itself with backspaces, so the next starts from the original text again:
+ *
+ *  - match:  typing ` + 1` at the end of a case of a `match` or `cases` (`->` at the end of the line is skipped)
+ *  - let:    adding a binding on a new line after a `let`, at the indentation of the line after it
+ *  - indent: indenting a line inside a block by two spaces, which moves it out of its layout, and dedenting it again
+ *  - doc:    typing words at the start of a doc block
+ *
+ * Or they are read from a file with one keystroke per line, `<byte offset> <bytes deleted> [inserted text]`, with
+ * `\n` and `\\` escaped.
+ *
+ * The reused-node ratio is the share of the parser's lookaheads that were subtrees of the old tree rather than fresh
+ * tokens, counted from the runtime's log in a second, untimed parse of the same edit. After every keystroke, the tree
+ * is compared node by node with a parse from scratch, so that layout state lost or misread in `deserialize` shows up
+ * as a failure rather than as a slightly different tree.
+ *
+ * It exits with 1 if any tree differed. Built like bench/parse.c, after `tree-sitter generate`, with `-ltree-sitter` or
+ * with the runtime's `lib/src/lib.c` and include directories from a tree-sitter checkout:
+ *
+ * script/generate-corpus.js 500 > corpus.u
+ * cc -O2 -Isrc bench/edit.c src/parser.c src/scanner.c -ltree-sitter -o edit && ./edit corpus.u [keystrokes.txt]
+ */
+#include <tree_sitter/api.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SITES 25 // per kind of script
+
+const TSLanguage *tree_sitter_unison(void);
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// --------------------------------------------------------------------------------------------------------
+// Text and keystrokes
+// --------------------------------------------------------------------------------------------------------
+
+typedef struct {
+  char *data;
+  uint32_t length;
+  uint32_t cap;
+} Text;
+
+typedef struct {
+  uint32_t offset;
+  uint32_t deleted;
+  char inserted[64];
+  uint8_t kind;
+} Keystroke;
+
+typedef struct {
+  Keystroke *data;
+  uint32_t len;
+  uint32_t cap;
+} Script;
+
+static const char *kind_names[] = {"match", "let", "indent", "doc", "recorded"};
+
+#define KIND_COUNT (sizeof(kind_names) / sizeof(kind_names[0]))
+
+static void keystroke(Script *script, uint8_t kind, uint32_t offset, uint32_t deleted, const char *inserted) {
+  if (script->len == script->cap) {
+    script->cap = script->cap ? script->cap * 2 : 256;
+    script->data = realloc(script->data, sizeof(Keystroke) * script->cap);
+  }
+  Keystroke *k = &script->data[script->len++];
+  *k = (Keystroke) {offset, deleted, "", kind};
+  snprintf(k->inserted, sizeof(k->inserted), "%s", inserted);
+}
+
+/**
+ * Type `s` at `offset` character by character, then delete it again with backspaces.
+ */
+static void type_and_undo(Script *script, uint8_t kind, uint32_t offset, const char *s) {
+  uint32_t n = strlen(s);
+  for (uint32_t i = 0; i < n; i++) {
+    char c[2] = {s[i], 0};
+    keystroke(script, kind, offset + i, 0, c);
+  }
+  for (uint32_t i = n; i > 0; i--) keystroke(script, kind, offset + i - 1, 1, "");
+}
+
+static uint32_t line_end(const Text *t, uint32_t i) {
+  while (i < t->length && t->data[i] != '\n') i++;
+  return i;
+}
+
+static uint32_t indentation(const Text *t, uint32_t line_start) {
+  uint32_t i = line_start;
+  while (i < t->length && t->data[i] == ' ') i++;
+  return i - line_start;
+}
+
+static bool starts_with(const Text *t, uint32_t i, const char *s) {
+  uint32_t n = strlen(s);
+  return i + n <= t->length && memcmp(t->data + i, s, n) == 0;
+}
+
+/**
+ * Up to `SITES` scripts of each kind, spread over the whole input.
+ */
+static void synthesize(const Text *t, Script *script) {
+  uint32_t found[4] = {0}, lines = 0;
+  for (uint32_t i = 0; i < t->length; i++) lines += t->data[i] == '\n';
+  uint32_t stride = lines / (SITES * 4) + 1, line = 0;
+  bool in_match = false;
+  for (uint32_t start = 0; start < t->length; start = line_end(t, start) + 1, line++) {
+    uint32_t end = line_end(t, start), indent = indentation(t, start);
+    if (indent == 0) in_match = false;
+    bool arrow = false;
+    for (uint32_t i = start; i + 1 < end; i++) {
+      if (starts_with(t, i, " with") || starts_with(t, i, "cases")) in_match = true;
+      if (starts_with(t, i, " -> ")) arrow = true;
+    }
+    bool pick = line % stride == 0;
+    if (in_match && arrow && pick && found[0] < SITES) {
+      found[0]++;
+      type_and_undo(script, 0, end, " + 1");
+    } else if (end >= start + 3 && starts_with(t, end - 3, "let") && end + 1 < t->length && found[1] < SITES) {
+      found[1]++;
+      uint32_t next = end + 1, width = indentation(t, next);
+      char binding[64];
+      snprintf(binding, sizeof(binding), "%*stmp = 42\n", (int) width, "");
+      type_and_undo(script, 1, next, binding);
+    } else if (indent > 0 && pick && found[2] < SITES) {
+      found[2]++;
+      type_and_undo(script, 2, start, "  ");
+    }
+    if (starts_with(t, start, "{{ ") && found[3] < SITES) {
+      found[3]++;
+      type_and_undo(script, 3, start + 3, "More words. ");
+    }
+  }
+}
+
+/**
+ * Read keystrokes from a file, one per line: `<byte offset> <bytes deleted> [inserted text]`.
+ */
+static void read_script(const char *path, Script *script) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    exit(1);
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    unsigned offset, deleted;
+    int used = 0;
+    if (sscanf(line, "%u %u %n", &offset, &deleted, &used) < 2) continue;
+    char inserted[64];
+    uint32_t n = 0;
+    for (char *p = line + used; *p && *p != '\n' && n < sizeof(inserted) - 1; p++) {
+      if (*p == '\\' && p[1] == 'n') inserted[n++] = '\n', p++;
+      else if (*p == '\\' && p[1] == '\\') inserted[n++] = '\\', p++;
+      else inserted[n++] = *p;
+    }
+    inserted[n] = 0;
+    keystroke(script, KIND_COUNT - 1, offset, deleted, inserted);
+  }
+  fclose(f);
+}
+
+static TSPoint point_at(const Text *t, uint32_t offset) {
+  TSPoint point = {0, 0};
+  for (uint32_t i = 0; i < offset; i++) {
+    if (t->data[i] == '\n') {
+      point.row++;
+      point.column = 0;
+    } else {
+      point.column++;
+    }
+  }
+  return point;
+}
+
+/**
+ * Apply a keystroke to the text and describe it as an edit of the tree.
+ */
+static TSInputEdit apply(Text *t, const Keystroke *k) {
+  uint32_t inserted = strlen(k->inserted);
+  TSInputEdit edit = {
+    .start_byte = k->offset,
+    .old_end_byte = k->offset + k->deleted,
+    .new_end_byte = k->offset + inserted,
+    .start_point = point_at(t, k->offset),
+    .old_end_point = point_at(t, k->offset + k->deleted),
+  };
+  if (t->length + inserted > t->cap) {
+    t->cap = (t->length + inserted) * 2;
+    t->data = realloc(t->data, t->cap);
+  }
+  memmove(t->data + k->offset + inserted, t->data + k->offset + k->deleted, t->length - k->offset - k->deleted);
+  memcpy(t->data + k->offset, k->inserted, inserted);
+  t->length += inserted - k->deleted;
+  edit.new_end_point = point_at(t, edit.new_end_byte);
+  return edit;
+}
+
+// --------------------------------------------------------------------------------------------------------
+// Trees
+// --------------------------------------------------------------------------------------------------------
+
+typedef struct {
+  unsigned long reused;
+  unsigned long lexed;
+} Lookaheads;
+
+static void count_lookaheads(void *payload, TSLogType type, const char *message) {
+  Lookaheads *l = payload;
+  if (type != TSLogTypeParse) return;
+  if (strncmp(message, "reuse_node", 10) == 0) l->reused++;
+  else if (strncmp(message, "lexed_lookahead", 15) == 0) l->lexed++;
+}
+
+static bool same_node(TSNode a, TSNode b) {
+  return ts_node_symbol(a) == ts_node_symbol(b) && ts_node_start_byte(a) == ts_node_start_byte(b) &&
+    ts_node_end_byte(a) == ts_node_end_byte(b) && ts_node_child_count(a) == ts_node_child_count(b) &&
+    ts_node_is_missing(a) == ts_node_is_missing(b);
+}
+
+/**
+ * Compare two trees node by node, and describe the first difference.
+ */
+static bool same_tree(TSTree *incremental, TSTree *full, char *difference, size_t size) {
+  TSTreeCursor a = ts_tree_cursor_new(ts_tree_root_node(incremental));
+  TSTreeCursor b = ts_tree_cursor_new(ts_tree_root_node(full));
+  bool same = true;
+  for (;;) {
+    TSNode x = ts_tree_cursor_current_node(&a), y = ts_tree_cursor_current_node(&b);
+    if (!same_node(x, y)) {
+      snprintf(difference, size, "%s %u-%u (%u children) instead of %s %u-%u (%u children)", ts_node_type(x),
+        ts_node_start_byte(x), ts_node_end_byte(x), ts_node_child_count(x), ts_node_type(y), ts_node_start_byte(y),
+        ts_node_end_byte(y), ts_node_child_count(y));
+      same = false;
+      break;
+    }
+    if (ts_tree_cursor_goto_first_child(&a)) {
+      ts_tree_cursor_goto_first_child(&b);
+      continue;
+    }
+    bool done = false;
+    while (!ts_tree_cursor_goto_next_sibling(&a)) {
+      ts_tree_cursor_goto_parent(&b);
+      if (!ts_tree_cursor_goto_parent(&a)) {
+        done = true;
+        break;
+      }
+    }
+    if (done) break;
+    ts_tree_cursor_goto_next_sibling(&b);
+  }
+  ts_tree_cursor_delete(&a);
+  ts_tree_cursor_delete(&b);
+  return same;
+}
+
+// --------------------------------------------------------------------------------------------------------
+// Harness
+// --------------------------------------------------------------------------------------------------------
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, uint32_t n, double p) {
+  return sorted[(uint32_t) (p * (n - 1) + 0.5)];
+}
+
+static void report(const char *name, double *ns, uint32_t n, Lookaheads *l) {
+  if (n == 0) return;
+  qsort(ns, n, sizeof(double), compare_doubles);
+  printf("%-10s %7u %10.1f %10.1f %10.1f %10.1f %9.1f%%\n", name, n, percentile(ns, n, 0.5) / 1e3,
+    percentile(ns, n, 0.95) / 1e3, percentile(ns, n, 0.99) / 1e3, ns[n - 1] / 1e3,
+    100.0 * l->reused / (l->reused + l->lexed ? l->reused + l->lexed : 1));
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <unison-file> [keystrokes]\n", argv[0]);
+    return 1;
+  }
+  FILE *f = fopen(argv[1], "rb");
+  if (f == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  fseek(f, 0, SEEK_END);
+  Text text = {.length = ftell(f)};
+  fseek(f, 0, SEEK_SET);
+  text.cap = text.length * 2 + 64;
+  text.data = malloc(text.cap);
+  text.length = fread(text.data, 1, text.length, f);
+  fclose(f);
+
+  Script script = {0};
+  if (argc > 2) read_script(argv[2], &script);
+  else synthesize(&text, &script);
+  if (script.len == 0) {
+    fprintf(stderr, "no keystrokes\n");
+    return 1;
+  }
+
+  TSParser *parser = ts_parser_new();
+  if (!ts_parser_set_language(parser, tree_sitter_unison())) {
+    fprintf(stderr, "the parser was generated for an incompatible version of the runtime\n");
+    return 1;
+  }
+  TSTree *tree = ts_parser_parse_string(parser, NULL, text.data, text.length);
+  double *ns = malloc(sizeof(double) * script.len), *by_kind = malloc(sizeof(double) * script.len);
+  Lookaheads lookaheads[KIND_COUNT] = {{0}}, all = {0};
+  TSLogger logger = {NULL, count_lookaheads};
+  unsigned long mismatches = 0;
+  char difference[256];
+
+  for (uint32_t i = 0; i < script.len; i++) {
+    const Keystroke *k = &script.data[i];
+    if (k->offset + k->deleted > text.length) {
+      fprintf(stderr, "keystroke %u is outside of the text\n", i);
+      return 1;
+    }
+    TSInputEdit edit = apply(&text, k);
+    ts_tree_edit(tree, &edit);
+    double start = now_ns();
+    TSTree *next = ts_parser_parse_string(parser, tree, text.data, text.length);
+    ns[i] = now_ns() - start;
+
+    logger.payload = &lookaheads[k->kind];
+    ts_parser_set_logger(parser, logger);
+    ts_tree_delete(ts_parser_parse_string(parser, tree, text.data, text.length));
+    ts_parser_set_logger(parser, (TSLogger) {NULL, NULL});
+    ts_tree_delete(tree);
+    tree = next;
+
+    TSTree *full = ts_parser_parse_string(parser, NULL, text.data, text.length);
+    if (!same_tree(tree, full, difference, sizeof(difference))) {
+      if (mismatches++ < 10) {
+        fprintf(stderr, "MISMATCH after keystroke %u (%s, %u -%u +'%s'): %s\n", i, kind_names[k->kind], k->offset,
+          k->deleted, k->inserted, difference);
+      }
+      // Continue from the correct tree, so that one mismatch doesn't cascade into all later ones.
+      ts_tree_delete(tree);
+      tree = full;
+    } else {
+      ts_tree_delete(full);
+    }
+  }
+
+  printf("%u keystrokes on %u bytes, latency in us\n", script.len, text.length);
+  printf("%-10s %7s %10s %10s %10s %10s %10s\n", "script", "keys", "p50", "p95", "p99", "max", "reused");
+  for (uint8_t kind = 0; kind < KIND_COUNT; kind++) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < script.len; i++) {
+      if (script.data[i].kind == kind) by_kind[n++] = ns[i];
+    }
+    report(kind_names[kind], by_kind, n, &lookaheads[kind]);
+    all.reused += lookaheads[kind].reused;
+    all.lexed += lookaheads[kind].lexed;
+  }
+  report("all", ns, script.len, &all);
+  if (mismatches > 0) printf("FAIL: %lu incremental trees differ from a parse from scratch\n", mismatches);
+  else printf("all incremental trees are the same as a parse from scratch\n");
+
+  ts_tree_delete(tree);
+  ts_parser_delete(parser);
+  free(ns);
+  free(by_kind);
+  free(script.data);
+  free(text.data);
+  return mismatches > 0;
+}
@@ -0,0 +1,158 @@
+/**
+ * Edit replay over a long fold.
+ *
+ * Appends a folded tail of about 5 MB to the input, splits it into chunks with the scanner, and then applies random
+ * small edits inside the tail. After each edit, the fold is re-lexed the way incremental parsing does it: from the
+ * start of the chunk that contains the edit, until a chunk ends where one ended before the edit. That is compared with
+ * scanning the fold as a single token, which has to be re-lexed up to the end of the file after every edit.
+ *
+ * cc -O2 -Isrc -Ibench bench/fold.c -o fold && ./fold [unison-file]
+ */
+#include "scanner.c"
+#include "mock_lexer.h"
+#include <string.h>
+#include <time.h>
+
+#define TAIL_BYTES (5 << 20)
+#define EDITS 200
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t rng = 0x9e3779b97f4a7c15u;
+
+static uint32_t next_random(uint32_t bound) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng % bound;
+}
+
+static const char *words[] = {
+  "the", "fold", "is", "not", "parsed", "--", "so", "anything", "goes", "{-", "here", "foo", "=", "bar", "x", "->",
+};
+
+/**
+ * Scan one chunk of the fold starting at `position`, and return where it ends.
+ */
+static uint32_t scan_chunk(void *scanner, MockLexer *m, uint32_t position, bool first) {
+  bool syms[FAIL + 1] = {false};
+  syms[first ? FOLD : FOLD_CONTINUATION] = true;
+  tree_sitter_unison_external_scanner_deserialize(scanner, NULL, 0);
+  mock_lexer_seek(m, position);
+  if (!tree_sitter_unison_external_scanner_scan(scanner, &m->lexer, syms)) {
+    fprintf(stderr, "no fold chunk at %u\n", position);
+    exit(1);
+  }
+  return mock_lexer_token_end(m);
+}
+
+/**
+ * Chunk the fold that starts at `fold`, writing the end of each chunk to `ends`. Returns the number of chunks.
+ */
+static uint32_t chunk_all(void *scanner, MockLexer *m, uint32_t fold, uint32_t *ends) {
+  uint32_t n = 0;
+  for (uint32_t position = fold; position < m->length; n++) {
+    position = ends[n] = scan_chunk(scanner, m, position, position == fold);
+  }
+  return n;
+}
+
+int main(int argc, char **argv) {
+  const char *head = "main : '{IO, Exception} ()\nmain _ = printLine \"hello\"\n";
+  uint32_t head_length;
+  int32_t *head_input = argc > 1 ? mock_read_file(argv[1], &head_length)
+                                 : mock_decode_utf8(head, strlen(head), &head_length);
+
+  uint32_t capacity = head_length + TAIL_BYTES + 4096;
+  int32_t *input = malloc(sizeof(int32_t) * capacity);
+  int32_t *edited = malloc(sizeof(int32_t) * capacity);
+  memcpy(input, head_input, sizeof(int32_t) * head_length);
+  uint32_t length = head_length;
+  const char *marker = "\n---\n";
+  uint32_t fold = length + 1;
+  for (const char *c = marker; *c; c++) input[length++] = *c;
+  while (length < head_length + TAIL_BYTES) {
+    uint32_t n = 1 + next_random(12);
+    for (uint32_t w = 0; w < n; w++) {
+      for (const char *c = words[next_random(sizeof(words) / sizeof(words[0]))]; *c; c++) input[length++] = *c;
+      input[length++] = ' ';
+    }
+    input[length - 1] = '\n';
+  }
+
+  void *scanner = tree_sitter_unison_external_scanner_create();
+  MockLexer m;
+  mock_lexer_init(&m, input, length);
+  uint32_t *ends = malloc(sizeof(uint32_t) * length);
+  uint32_t chunks = chunk_all(scanner, &m, fold, ends);
+  printf("fold of %u characters in %u chunks, %.0f characters per chunk\n", length - fold, chunks,
+    (double) (length - fold) / chunks);
+
+  unsigned long scanned = 0, whole = 0;
+  double chunked_ns = 0, whole_ns = 0;
+  for (int e = 0; e < EDITS; e++) {
+    // Replace up to 8 characters at a random position in the fold with up to 8 others.
+    uint32_t at = fold + next_random(length - fold - 8);
+    uint32_t removed = next_random(9), inserted = next_random(9);
+    memcpy(edited, input, sizeof(int32_t) * at);
+    for (uint32_t i = 0; i < inserted; i++) edited[at + i] = next_random(4) == 0 ? '\n' : 'a' + next_random(26);
+    memcpy(edited + at + inserted, input + at + removed, sizeof(int32_t) * (length - at - removed));
+    uint32_t edited_length = length - removed + inserted;
+    int64_t shift = (int64_t) inserted - removed;
+
+    // The first chunk that overlaps the edit, and the first old chunk end that is past it.
+    uint32_t c = 0;
+    while (c < chunks && ends[c] < at) c++;
+    uint32_t start = c == 0 ? fold : ends[c - 1];
+    uint32_t old = c;
+    while (old < chunks && ends[old] <= at + removed) old++;
+
+    mock_lexer_init(&m, edited, edited_length);
+    double t = now_ns();
+    uint32_t position = start;
+    do {
+      position = scan_chunk(scanner, &m, position, position == fold);
+      while (old < chunks && ends[old] + shift < position) old++;
+    } while (position < edited_length && !(old < chunks && ends[old] + shift == position));
+    chunked_ns += now_ns() - t;
+    scanned += m.advances;
+
+    m.advances = 0;
+    t = now_ns();
+    mock_lexer_seek(&m, fold);
+    while (!mock_lexer_eof(&m.lexer)) m.lexer.advance(&m.lexer, false);
+    whole_ns += now_ns() - t;
+    whole += m.advances;
+
+    int32_t *swap = input;
+    input = edited;
+    edited = swap;
+    length = edited_length;
+    mock_lexer_init(&m, input, length);
+    chunks = chunk_all(scanner, &m, fold, ends);
+
+    // The chunks after the point where re-lexing stopped must be the ones a full scan of the edited fold produces.
+    uint32_t k = 0;
+    while (k < chunks && ends[k] < position) k++;
+    if (k == chunks || ends[k] != position) {
+      fprintf(stderr, "FAIL: re-lexing stopped at %u, which is not a chunk boundary\n", position);
+      return 1;
+    }
+  }
+
+  printf("chunked:      %9.0f characters re-scanned per edit, %8.1f us\n", (double) scanned / EDITS,
+    chunked_ns / EDITS / 1e3);
+  printf("single token: %9.0f characters re-scanned per edit, %8.1f us\n", (double) whole / EDITS,
+    whole_ns / EDITS / 1e3);
+
+  tree_sitter_unison_external_scanner_destroy(scanner);
+  free(ends);
+  free(edited);
+  free(input);
+  free(head_input);
+  return 0;
+}
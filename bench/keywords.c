@@ -0,0 +1,104 @@
+/**
+ * Microbenchmark for recognizing the layout-relevant keywords (`where`, `with`, `in`, `then`, `else`).
+ *
+ * Compares the old chain of `token()` probes with the keyword DFA in `src/scanner.c`, at the start of every word in
+ * the input that begins with one of the keywords' first letters.
+ *
+ * script/generate-corpus.js 5000 keywords > keywords.u
+ * cc -O2 -Isrc -Ibench bench/keywords.c -o keywords && ./keywords keywords.u
+ */
+#include "scanner.c"
+#include "mock_lexer.h"
+#include <time.h>
+
+#define ROUNDS 20
+
+// --------------------------------------------------------------------------------------------------------
+// Probe chain, as it was before the DFA
+// --------------------------------------------------------------------------------------------------------
+
+static bool old_seq(const char *s, State *state) {
+  size_t len = strlen(s);
+  for (size_t i = 0; i < len; i++) {
+    if (s[i] != PEEK) return false;
+    S_ADVANCE;
+  }
+  return true;
+}
+
+static bool old_token(const char *s, State *state) { return old_seq(s, state) && token_end(PEEK); }
+
+static Keyword old_keyword(State *state) {
+  switch (PEEK) {
+    case 'w':
+      S_ADVANCE;
+      if (old_token("here", state)) return KW_WHERE;
+      if (old_token("ith", state)) return KW_WITH;
+      return KW_NONE;
+    case 'i': return old_token("in", state) ? KW_IN : KW_NONE;
+    case 'e': return old_token("else", state) ? KW_ELSE : KW_NONE;
+    case 't': return old_token("then", state) ? KW_THEN : KW_NONE;
+    default: return KW_NONE;
+  }
+}
+
+static Keyword dfa_keyword(State *state) {
+  uint32_t length;
+  return keyword(&length, state);
+}
+
+// --------------------------------------------------------------------------------------------------------
+// Harness
+// --------------------------------------------------------------------------------------------------------
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(const char *name, Keyword (*recognize)(State *), MockLexer *m, const uint32_t *starts, size_t n) {
+  bool syms[FAIL + 1] = {false};
+  indent_vec indents = {0};
+  unsigned long found[KW_ELSE + 1] = {0};
+  m->advances = 0;
+  double start = now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (size_t i = 0; i < n; i++) {
+      mock_lexer_seek(m, starts[i]);
+      State state = state_new(&m->lexer, syms, &indents);
+      found[recognize(&state)]++;
+    }
+  }
+  double ns = (now_ns() - start) / ((double) ROUNDS * n);
+  printf("%-6s %6.2f ns/probe, %5.2f advances/probe, where %lu with %lu in %lu then %lu else %lu\n",
+    name, ns, (double) m->advances / ((double) ROUNDS * n),
+    found[KW_WHERE] / ROUNDS, found[KW_WITH] / ROUNDS, found[KW_IN] / ROUNDS, found[KW_THEN] / ROUNDS,
+    found[KW_ELSE] / ROUNDS);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <unison-file>\n", argv[0]);
+    return 1;
+  }
+  uint32_t length;
+  int32_t *input = mock_read_file(argv[1], &length);
+  uint32_t *starts = malloc(sizeof(uint32_t) * (length + 1));
+  size_t n = 0;
+  for (uint32_t i = 0; i < length; i++) {
+    bool word_start = i == 0 || !(char_class(input[i - 1]) & C_IDENT);
+    int32_t c = input[i];
+    if (word_start && (c == 'w' || c == 'i' || c == 't' || c == 'e')) starts[n++] = i;
+  }
+  printf("%zu candidate positions in %u characters\n", n, length);
+
+  MockLexer m;
+  mock_lexer_init(&m, input, length);
+  run("probes", old_keyword, &m, starts, n);
+  run("dfa", dfa_keyword, &m, starts, n);
+
+  free(starts);
+  free(input);
+  return 0;
+}
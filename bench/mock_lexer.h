@@ -0,0 +1,125 @@
+/**
+ * An in-memory implementation of `TSLexer` for driving the external scanner without the tree-sitter runtime.
+ *
+ * The input is a buffer of code points. `get_column` walks back to the start of the line like the runtime does, so
+ * its cost is representative. It, `advance` and `mark_end` are counted.
+ */
+#ifndef TREE_SITTER_UNISON_MOCK_LEXER_H_
+#define TREE_SITTER_UNISON_MOCK_LEXER_H_
+
+#include "tree_sitter/parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+  TSLexer lexer; // must be first, the callbacks cast back to `MockLexer`
+  const int32_t *input;
+  uint32_t length;
+  uint32_t position;
+  uint32_t marked;
+  bool did_mark;
+  unsigned long advances;
+  unsigned long marks;
+  unsigned long column_queries;
+} MockLexer;
+
+static inline void mock_lexer_load(MockLexer *m) {
+  m->lexer.lookahead = m->position < m->length ? m->input[m->position] : 0;
+}
+
+static inline void mock_lexer_advance(TSLexer *l, bool skip) {
+  (void) skip;
+  MockLexer *m = (MockLexer *) l;
+  m->advances++;
+  if (m->position < m->length) m->position++;
+  mock_lexer_load(m);
+}
+
+static inline void mock_lexer_mark_end(TSLexer *l) {
+  MockLexer *m = (MockLexer *) l;
+  m->marks++;
+  m->marked = m->position;
+  m->did_mark = true;
+}
+
+static inline uint32_t mock_lexer_get_column(TSLexer *l) {
+  MockLexer *m = (MockLexer *) l;
+  m->column_queries++;
+  uint32_t column = 0;
+  for (uint32_t p = m->position; p > 0 && m->input[p - 1] != '\n'; p--) column++;
+  return column;
+}
+
+static inline bool mock_lexer_eof(const TSLexer *l) {
+  const MockLexer *m = (const MockLexer *) l;
+  return m->position >= m->length;
+}
+
+/**
+ * Position the lexer at `position` as if the runtime was about to call the scanner there.
+ */
+static inline void mock_lexer_seek(MockLexer *m, uint32_t position) {
+  m->position = position;
+  m->marked = position;
+  m->did_mark = false;
+  mock_lexer_load(m);
+}
+
+static inline void mock_lexer_init(MockLexer *m, const int32_t *input, uint32_t length) {
+  *m = (MockLexer) {
+    .lexer = {
+      .advance = mock_lexer_advance,
+      .mark_end = mock_lexer_mark_end,
+      .get_column = mock_lexer_get_column,
+      .eof = mock_lexer_eof,
+    },
+    .input = input,
+    .length = length,
+  };
+  mock_lexer_seek(m, 0);
+}
+
+/**
+ * The end of the token the scanner produced, in code points.
+ */
+static inline uint32_t mock_lexer_token_end(const MockLexer *m) { return m->did_mark ? m->marked : m->position; }
+
+/**
+ * Decode UTF-8 into a freshly allocated buffer of code points. Malformed sequences are decoded leniently.
+ */
+static inline int32_t *mock_decode_utf8(const char *s, size_t n, uint32_t *length) {
+  int32_t *result = malloc(sizeof(int32_t) * (n + 1));
+  uint32_t k = 0;
+  for (size_t i = 0; i < n;) {
+    unsigned char c = s[i];
+    int len = c < 0x80 ? 1 : (c >> 5) == 6 ? 2 : (c >> 4) == 14 ? 3 : 4;
+    int32_t cp = len == 1 ? c : len == 2 ? (c & 0x1f) : len == 3 ? (c & 0x0f) : (c & 0x07);
+    for (int j = 1; j < len && i + j < n; j++) cp = (cp << 6) | (s[i + j] & 0x3f);
+    result[k++] = cp;
+    i += len;
+  }
+  *length = k;
+  return result;
+}
+
+/**
+ * Read a UTF-8 file into a buffer of code points, or exit with an error.
+ */
+static inline int32_t *mock_read_file(const char *path, uint32_t *length) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  long n = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *bytes = malloc(n + 1);
+  size_t read = fread(bytes, 1, n, f);
+  fclose(f);
+  int32_t *result = mock_decode_utf8(bytes, read, length);
+  free(bytes);
+  return result;
+}
+
+#endif // TREE_SITTER_UNISON_MOCK_LEXER_H_
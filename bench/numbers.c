@@ -0,0 +1,179 @@
+/**
+ * Microbenchmark for lexing numeric literals.
+ *
+ * Compares the old way of getting a checked number out of the source with `number` in `src/scanner.c`, which lexes
+ * and range checks it in one pass. Before, the runtime called the scanner at every number just to have it fail, matched
+ * the token with the grammar's regexes, and the value had to be parsed a second time with `strtoull`/`strtoll` to find
+ * out whether it is in range. It runs at every number in the input, and fails if the two disagree on the extent, kind or
+ * range of any of them. The literals out of range are also timed on their own.
+ *
+ * script/generate-corpus.js 2000 numbers > numbers.u
+ * cc -O2 -Isrc -Ibench bench/numbers.c -o numbers && ./numbers numbers.u
+ */
+#include "scanner.c"
+#include "mock_lexer.h"
+#include <errno.h>
+#include <time.h>
+
+#define ROUNDS 50
+
+// --------------------------------------------------------------------------------------------------------
+// Regexes and range check, as they were before `number`
+// --------------------------------------------------------------------------------------------------------
+
+typedef struct {
+  Sym sym; // FAIL if out of range
+  uint32_t end;
+} Lexed;
+
+static uint32_t old_digits(const int32_t *s, uint32_t p, uint32_t len) {
+  while (p < len && s[p] >= '0' && s[p] <= '9') p++;
+  return p;
+}
+
+static uint32_t old_hex_digits(const int32_t *s, uint32_t p, uint32_t len) {
+  while (p < len && hex_digit(s[p]) >= 0) p++;
+  return p;
+}
+
+/**
+ * Longest match of `nat: /[0-9]+/`, `int: /[+-][0-9]+/`, `float: /[-+]?[0-9]*\.?[0-9]+([eE][-+]?[0-9]+)?/`,
+ * `literal_hex: /0x[0-9a-fA-F]+/` and `literal_byte: /0xs[0-9a-fA-F]+/`, followed by the conversion that was needed
+ * to find out whether the literal is in range.
+ */
+static Lexed old_number(const int32_t *s, uint32_t start, uint32_t len) {
+  char text[128];
+  uint32_t p = start;
+  bool sign = s[p] == '+' || s[p] == '-';
+  if (sign) p++;
+  Lexed lexed = {sign ? INT : NAT, 0};
+  if (!sign && p + 2 < len && s[p] == '0' && s[p + 1] == 'x') {
+    bool bytes = s[p + 2] == 's';
+    uint32_t end = old_hex_digits(s, p + (bytes ? 3 : 2), len);
+    if (end > p + (bytes ? 3 : 2)) {
+      lexed = (Lexed) {bytes ? BYTES : HEX, end};
+      if (bytes) return lexed;
+      p += 2;
+    }
+  }
+  if (lexed.end == 0) {
+    p = lexed.end = old_digits(s, p, len);
+    if (p + 1 < len && s[p] == '.' && is_digit(s[p + 1])) {
+      p = lexed.end = old_digits(s, p + 1, len);
+      lexed.sym = FLOAT;
+    }
+    if (p < len && (s[p] == 'e' || s[p] == 'E')) {
+      uint32_t q = p + 1;
+      if (q < len && (s[q] == '+' || s[q] == '-')) q++;
+      uint32_t end = old_digits(s, q, len);
+      if (end > q) {
+        lexed.end = end;
+        lexed.sym = FLOAT;
+      }
+    }
+  }
+  if (lexed.sym == FLOAT) return lexed;
+  uint32_t n = 0;
+  for (uint32_t i = start; i < lexed.end && n < sizeof(text) - 1; i++) text[n++] = (char) s[i];
+  text[n] = 0;
+  errno = 0;
+  if (lexed.sym == HEX) strtoull(text + 2, NULL, 16);
+  else if (lexed.sym == NAT) strtoull(text, NULL, 10);
+  else strtoll(text, NULL, 10);
+  if (errno == ERANGE) lexed.sym = FAIL;
+  return lexed;
+}
+
+// --------------------------------------------------------------------------------------------------------
+// Harness
+// --------------------------------------------------------------------------------------------------------
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static bool syms[FAIL + 1];
+static bool old_syms[FAIL + 1];
+
+/**
+ * The scanner call that preceded the regexes, with the same valid symbols except for the numbers.
+ */
+static Lexed old_scan_and_number(void *scanner, MockLexer *m, uint32_t start) {
+  mock_lexer_seek(m, start);
+  if (tree_sitter_unison_external_scanner_scan(scanner, &m->lexer, old_syms)) return (Lexed) {FAIL, 0};
+  return old_number(m->input, start, m->length);
+}
+
+static Lexed new_number(void *scanner, MockLexer *m, uint32_t start) {
+  mock_lexer_seek(m, start);
+  if (!tree_sitter_unison_external_scanner_scan(scanner, &m->lexer, syms)) return (Lexed) {FAIL, 0};
+  return (Lexed) {m->lexer.result_symbol, mock_lexer_token_end(m)};
+}
+
+static double ns_per_number(Lexed (*lex)(void *, MockLexer *, uint32_t), void *scanner, MockLexer *m,
+  const uint32_t *at, size_t count, unsigned long *checksum) {
+  double start = now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (size_t i = 0; i < count; i++) *checksum += lex(scanner, m, at[i]).end;
+  }
+  return (now_ns() - start) / ((double) ROUNDS * count);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <unison-file>\n", argv[0]);
+    return 1;
+  }
+  uint32_t length;
+  int32_t *input = mock_read_file(argv[1], &length);
+  uint32_t *starts = calloc(length + 1, sizeof(uint32_t));
+  size_t n = 0;
+  for (uint32_t i = 0; i < length; i++) {
+    bool after_space = i == 0 || isws(input[i - 1]) || input[i - 1] == '(' || input[i - 1] == '[';
+    uint32_t j = i + (input[i] == '+' || input[i] == '-'); // the digit after an optional sign and dot
+    if (j < length && input[j] == '.') j++;
+    if (after_space && j < length && is_digit(input[j])) starts[n++] = i;
+  }
+  printf("%zu numbers in %u characters\n", n, length);
+  syms[NAT] = syms[INT] = syms[FLOAT] = syms[HEX] = syms[BYTES] = true;
+  syms[COMMENT] = syms[SYMOP] = true;
+  old_syms[COMMENT] = old_syms[SYMOP] = true;
+
+  void *scanner = tree_sitter_unison_external_scanner_create();
+  MockLexer m;
+  mock_lexer_init(&m, input, length);
+  size_t out_of_range = 0;
+  uint32_t *overflows = malloc(sizeof(uint32_t) * (n + 1));
+  for (size_t i = 0; i < n; i++) {
+    Lexed old = old_scan_and_number(scanner, &m, starts[i]), new = new_number(scanner, &m, starts[i]);
+    if (old.sym != new.sym || (old.sym != FAIL && old.end != new.end)) {
+      fprintf(stderr, "FAIL: number at %u is %d until %u, was %d until %u\n", starts[i], new.sym, new.end, old.sym,
+        old.end);
+      return 1;
+    }
+    if (old.sym == FAIL) overflows[out_of_range++] = starts[i];
+  }
+  printf("%zu out of range, all the same as before\n", out_of_range);
+
+  unsigned long checksum = 0;
+  double old_ns = ns_per_number(old_scan_and_number, scanner, &m, starts, n, &checksum);
+  m.advances = m.marks = 0;
+  double new_ns = ns_per_number(new_number, scanner, &m, starts, n, &checksum);
+  printf("scan + regex + strtoull: %6.2f ns/number\n", old_ns);
+  printf("number:                 %6.2f ns/number, %5.2f advances/number, %5.2f mark_end/number (%lu)\n", new_ns,
+    (double) m.advances / ((double) ROUNDS * n), (double) m.marks / ((double) ROUNDS * n), checksum % 10);
+  if (out_of_range > 0) {
+    // The literals that fail the range check, on their own.
+    old_ns = ns_per_number(old_scan_and_number, scanner, &m, overflows, out_of_range, &checksum);
+    new_ns = ns_per_number(new_number, scanner, &m, overflows, out_of_range, &checksum);
+    printf("out of range:            %6.2f ns/number before, %6.2f ns/number with `number`\n", old_ns, new_ns);
+  }
+
+  tree_sitter_unison_external_scanner_destroy(scanner);
+  free(overflows);
+  free(starts);
+  free(input);
+  return 0;
+}
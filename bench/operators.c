@@ -0,0 +1,140 @@
+/**
+ * Microbenchmark for scanning runs of symbolic characters.
+ *
+ * Compares the old operator loop, which marked the token end after every character and tracked `|` and `&` through
+ * wrapping `uint8_t` counters, with `symbolic_run` in `src/scanner.c`, at every operator that follows whitespace.
+ * The two alternate for a number of repeats, so neither gets the warm-up, and the minimum and median are reported.
+ *
+ * On `generate-corpus.js 5000 operators`, the new loop calls `mark_end` 0.77 times per run instead of 2.40. Over five
+ * invocations, the minimum was 32.8-33.9 ns per run against 37.6-38.2 ns, and the median 33.1-35.2 ns against
+ * 38.1-41.2 ns, so about 12%. A single pass of each, old first, is within the noise of a few percent.
+ *
+ * script/generate-corpus.js 5000 operators > operators.u
+ * cc -O2 -Isrc -Ibench bench/operators.c -o operators && ./operators operators.u
+ */
+#include "scanner.c"
+#include "mock_lexer.h"
+#include <time.h>
+
+#define ROUNDS 50
+#define REPEATS 9
+
+// --------------------------------------------------------------------------------------------------------
+// Operator loop, as it was before `symbolic_run`
+// --------------------------------------------------------------------------------------------------------
+
+static bool found_pipe_or_logical_op(uint8_t pipe_count, uint8_t amp_count) {
+  return pipe_count == 1 || pipe_count == 2 || amp_count == 2;
+}
+
+static Result old_symbolic_run(State *state) {
+  uint8_t and_count = 0;
+  uint8_t or_count = 0;
+  bool previous_was_colon = false;
+  bool is_on_first_char = true;
+  bool arrow_has_begun = false;
+  while (!is_eof(state)) {
+    if (arrow_has_begun && PEEK == '>') return res_fail;
+    if (PEEK == '-' && is_on_first_char) arrow_has_begun = true;
+    if (!symbolic(PEEK) && previous_was_colon) return res_fail;
+    if (symbolic(PEEK)) {
+      previous_was_colon = false;
+      switch (PEEK) {
+        case '|': {
+          if (or_count == 0 || or_count == 1) ++or_count;
+          break;
+        }
+        case '&': {
+          if (and_count == 0 || and_count == 1) ++and_count;
+          break;
+        }
+        case ':': previous_was_colon = true; // fall through
+        default: {
+          or_count = -1;
+          and_count = -1;
+        }
+      }
+      S_ADVANCE;
+      MARK("operator", false, state);
+    } else {
+      if (found_pipe_or_logical_op(or_count, and_count)) return res_fail;
+      return (isws(PEEK) || PEEK == '#') ? finish_if_valid(SYMOP, "symbolic operator", state) : res_fail;
+    }
+    is_on_first_char = false;
+  }
+  if (found_pipe_or_logical_op(or_count, and_count)) return res_fail;
+  S_ADVANCE;
+  MARK("operator", false, state);
+  return finish_if_valid(SYMOP, "symbolic operator", state);
+}
+
+static Result new_symbolic_run(State *state) { return symbolic_run((Segment) {0}, 0, state); }
+
+// --------------------------------------------------------------------------------------------------------
+// Harness
+// --------------------------------------------------------------------------------------------------------
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static double run(const char *name, Result (*scan)(State *), MockLexer *m, const uint32_t *starts, size_t n,
+                  bool print) {
+  bool syms[FAIL + 1] = {false};
+  syms[SYMOP] = true;
+  indent_vec indents = {0};
+  unsigned long operators = 0;
+  m->advances = m->marks = 0;
+  double start = now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (size_t i = 0; i < n; i++) {
+      mock_lexer_seek(m, starts[i]);
+      State state = state_new(&m->lexer, syms, &indents);
+      operators += scan(&state).sym == SYMOP;
+    }
+  }
+  double ns = (now_ns() - start) / ((double) ROUNDS * n);
+  if (print) {
+    printf("%-6s %5.2f advances/run, %5.2f mark_end/run, %lu operators\n", name,
+      (double) m->advances / ((double) ROUNDS * n), (double) m->marks / ((double) ROUNDS * n), operators / ROUNDS);
+  }
+  return ns;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <unison-file>\n", argv[0]);
+    return 1;
+  }
+  uint32_t length;
+  int32_t *input = mock_read_file(argv[1], &length);
+  uint32_t *starts = calloc(length + 1, sizeof(uint32_t));
+  size_t n = 0;
+  for (uint32_t i = 0; i < length; i++) {
+    if (symbolic(input[i]) && (i == 0 || isws(input[i - 1]))) starts[n++] = i;
+  }
+  printf("%zu symbolic runs in %u characters\n", n, length);
+
+  MockLexer m;
+  mock_lexer_init(&m, input, length);
+  double old_ns[REPEATS], new_ns[REPEATS];
+  for (int r = 0; r < REPEATS; r++) {
+    old_ns[r] = run("old", old_symbolic_run, &m, starts, n, r == 0);
+    new_ns[r] = run("new", new_symbolic_run, &m, starts, n, r == 0);
+  }
+  qsort(old_ns, REPEATS, sizeof(double), compare_doubles);
+  qsort(new_ns, REPEATS, sizeof(double), compare_doubles);
+  printf("old    %6.2f ns/run minimum, %6.2f median\n", old_ns[0], old_ns[REPEATS / 2]);
+  printf("new    %6.2f ns/run minimum, %6.2f median\n", new_ns[0], new_ns[REPEATS / 2]);
+
+  free(starts);
+  free(input);
+  return 0;
+}
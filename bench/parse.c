@@ -0,0 +1,134 @@
+/**
+ * Throughput of full parses with the generated parser, the external scanner and the tree-sitter runtime.
+ *
+ * Parses the whole input from scratch a number of times and reports the MB/s, the ns per token (a leaf of the tree,
+ * named or not) and the peak resident set size, once before parsing and once after. Each round frees the tree of the
+ * round before, so the peak is that of one tree. A line of JSON with the same numbers is appended to the output file,
+ * `bench_output.txt` by default.
+ *
+ * script/bench-parse builds and runs it on a corpus of the `stress` shape. By hand, after `tree-sitter generate`, with
+ * the runtime installed or checked out next to this repository:
+ *
+ * script/generate-corpus.js 100000 stress > stress.u
+ * cc -O2 -Isrc bench/parse.c src/parser.c src/scanner.c -ltree-sitter -o parse && ./parse stress.u
+ * cc -O2 -Isrc -I../tree-sitter/lib/include -I../tree-sitter/lib/src bench/parse.c src/parser.c src/scanner.c \
+ *   ../tree-sitter/lib/src/lib.c -o parse && ./parse stress.u
+ */
+#include <tree_sitter/api.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define ROUNDS 5
+
+const TSLanguage *tree_sitter_unison(void);
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * The peak resident set size of the process so far, in KB.
+ */
+static long peak_rss_kb(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static char *read_file(const char *path, uint32_t *length) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *text = malloc(size + 1);
+  if (fread(text, 1, size, f) != (size_t) size) {
+    perror(path);
+    exit(1);
+  }
+  fclose(f);
+  text[size] = 0;
+  *length = (uint32_t) size;
+  return text;
+}
+
+/**
+ * The number of leaves of the tree, and of the error and missing nodes in it.
+ */
+static unsigned long count_tokens(TSTree *tree, unsigned long *errors) {
+  TSTreeCursor cursor = ts_tree_cursor_new(ts_tree_root_node(tree));
+  unsigned long tokens = 0;
+  for (;;) {
+    TSNode node = ts_tree_cursor_current_node(&cursor);
+    *errors += ts_node_is_error(node) || ts_node_is_missing(node);
+    if (ts_tree_cursor_goto_first_child(&cursor)) continue;
+    tokens++;
+    while (!ts_tree_cursor_goto_next_sibling(&cursor)) {
+      if (!ts_tree_cursor_goto_parent(&cursor)) {
+        ts_tree_cursor_delete(&cursor);
+        return tokens;
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <unison-file> [output-file]\n", argv[0]);
+    return 1;
+  }
+  const char *output = argc > 2 ? argv[2] : "bench_output.txt";
+  uint32_t length;
+  char *text = read_file(argv[1], &length);
+  long baseline_kb = peak_rss_kb();
+
+  TSParser *parser = ts_parser_new();
+  if (!ts_parser_set_language(parser, tree_sitter_unison())) {
+    fprintf(stderr, "the parser was generated for an incompatible version of the runtime\n");
+    return 1;
+  }
+  TSTree *tree = NULL;
+  double ns = 0, best_ns = 0;
+  for (int r = 0; r < ROUNDS; r++) {
+    ts_tree_delete(tree);
+    double start = now_ns();
+    tree = ts_parser_parse_string(parser, NULL, text, length);
+    double round_ns = now_ns() - start;
+    ns += round_ns;
+    if (r == 0 || round_ns < best_ns) best_ns = round_ns;
+  }
+  long peak_kb = peak_rss_kb();
+  unsigned long errors = 0, tokens = count_tokens(tree, &errors);
+  double mb = length / 1048576.0, mean_ns = ns / ROUNDS;
+
+  printf("%u bytes, %lu tokens, %lu errors\n", length, tokens, errors);
+  printf("%d rounds: %8.2f MB/s (best %8.2f), %6.2f ns/token\n", ROUNDS, mb / (mean_ns / 1e9), mb / (best_ns / 1e9),
+    mean_ns / tokens);
+  printf("peak RSS: %ld KB, %ld KB before parsing\n", peak_kb, baseline_kb);
+
+  const char *name = strrchr(argv[1], '/') ? strrchr(argv[1], '/') + 1 : argv[1];
+  FILE *out = fopen(output, "a");
+  if (!out) {
+    perror(output);
+    return 1;
+  }
+  fprintf(out,
+    "{\"file\":\"%s\",\"bytes\":%u,\"tokens\":%lu,\"errors\":%lu,\"rounds\":%d,\"mb_per_s\":%.3f,"
+    "\"best_mb_per_s\":%.3f,\"ns_per_token\":%.3f,\"peak_rss_kb\":%ld,\"baseline_rss_kb\":%ld}\n",
+    name, length, tokens, errors, ROUNDS, mb / (mean_ns / 1e9), mb / (best_ns / 1e9), mean_ns / tokens, peak_kb,
+    baseline_kb);
+  fclose(out);
+
+  ts_tree_delete(tree);
+  ts_parser_delete(parser);
+  free(text);
+  return 0;
+}
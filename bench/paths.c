@@ -0,0 +1,206 @@
+/**
+ * Paths (the namespace prefix of a qualified name) in the external scanner.
+ *
+ * Checks the scanner against the regex that `path` was in `grammar/regex.js`, as a POSIX extended regex, whose
+ * leftmost-longest match is the token the generated lexer produced. That runs on random strings over an alphabet of
+ * word, symbolic and keyword characters and dots, after a space and at the start of a line, with `PATH` alone and
+ * together with `;`, `.`, the end and the start of a layout. It fails at the first string for which the two disagree on
+ * whether there is a path or where it ends. Two other tokens are expected where the regex found a path, since they
+ * won over it before as well: a zero-width layout token, after which the next call must produce the same path, and a
+ * `--` at the start of a line or a layout, which is a comment or a fold. Emoji are left out, since `regex.h` works on bytes.
+ *
+ * It then times the scanner at every name in the input that follows whitespace or a parenthesis, against the call
+ * that failed there before, with `PATH` not valid.
+ *
+ * script/generate-corpus.js 2000 qualified > qualified.u
+ * cc -O2 -Isrc -Ibench bench/paths.c -o paths && ./paths qualified.u
+ */
+#include "scanner.c"
+#include "mock_lexer.h"
+#include <regex.h>
+#include <string.h>
+#include <time.h>
+
+#define CASES 200000
+#define MAX_CASE 12
+#define ROUNDS 50
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t rng = 0x9e3779b97f4a7c15u;
+
+static uint32_t next_random(uint32_t bound) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng % bound;
+}
+
+// --------------------------------------------------------------------------------------------------------
+// The regex, as it was before `path`
+// --------------------------------------------------------------------------------------------------------
+
+static const char *old_path =
+  "^\\.?(("
+  "[_a-zA-Z][_!'a-zA-Z]+|"
+  "[$%^&*+<>~\\/:-]|"
+  "-[!$%^&*=+<~\\/|:-]|"
+  "[!$%^*=+<>~\\/:]{2}|"
+  "&[!$%^*=+<>~\\/|:-]|"
+  "\\|[!$%^&*=+<>~\\/:-]|"
+  "[!$%^&*=+<>~\\/|:-]{3,}"
+  ")\\.)+";
+
+/**
+ * The length of the path at the start of `s`, or 0.
+ */
+static uint32_t old_path_length(regex_t *re, const char *s) {
+  regmatch_t match;
+  return regexec(re, s, 1, &match, 0) == 0 ? (uint32_t) match.rm_eo : 0;
+}
+
+// --------------------------------------------------------------------------------------------------------
+// Harness
+// --------------------------------------------------------------------------------------------------------
+
+/**
+ * The length of the path the scanner produces at `start`, or 0.
+ */
+static uint32_t new_path_length(void *scanner, MockLexer *m, uint32_t start, bool *syms) {
+  mock_lexer_seek(m, start);
+  if (!tree_sitter_unison_external_scanner_scan(scanner, &m->lexer, syms) || m->lexer.result_symbol != PATH) return 0;
+  return mock_lexer_token_end(m) - start;
+}
+
+/**
+ * Random strings after `prefix`, which is a space or a line break and an indent. The scanner's state is restored after
+ * each call, since a line break can close layouts.
+ */
+static bool fuzz(regex_t *re, bool *syms, const char *prefix, const char *name) {
+  static const char alphabet[] = "ab_'!1.....-+>=|&:$*Tthenwi";
+  void *scanner = tree_sitter_unison_external_scanner_create();
+  char state[TREE_SITTER_SERIALIZATION_BUFFER_SIZE];
+  unsigned state_length = tree_sitter_unison_external_scanner_serialize(scanner, state);
+  uint32_t skip = strlen(prefix);
+  bool line_start = prefix[0] == '\n';
+  char text[MAX_CASE + 1];
+  int32_t input[MAX_CASE + 8];
+  unsigned long paths = 0, others = 0, comments = 0;
+  bool ok = true;
+  for (uint32_t c = 0; c < CASES && ok; c++) {
+    uint32_t len = 1 + next_random(MAX_CASE);
+    for (uint32_t i = 0; i < skip; i++) input[i] = prefix[i];
+    for (uint32_t i = 0; i < len; i++) input[i + skip] = text[i] = alphabet[next_random(sizeof(alphabet) - 1)];
+    text[len] = 0;
+    MockLexer m;
+    mock_lexer_init(&m, input, len + skip);
+    bool found = tree_sitter_unison_external_scanner_scan(scanner, &m.lexer, syms);
+    uint32_t end = mock_lexer_token_end(&m);
+    tree_sitter_unison_external_scanner_deserialize(scanner, state, state_length);
+    if (found && m.lexer.result_symbol != PATH && end <= skip) {
+      // A zero-width layout token. The next call can't produce it again.
+      Sym layout = m.lexer.result_symbol;
+      syms[layout] = false;
+      mock_lexer_seek(&m, skip);
+      found = tree_sitter_unison_external_scanner_scan(scanner, &m.lexer, syms);
+      end = mock_lexer_token_end(&m);
+      tree_sitter_unison_external_scanner_deserialize(scanner, state, state_length);
+      syms[layout] = true;
+      others += found && m.lexer.result_symbol == PATH;
+    }
+    uint32_t old = old_path_length(re, text), new = found && m.lexer.result_symbol == PATH ? end - skip : 0;
+    paths += old > 0;
+    if (old == new) continue;
+    if (new == 0 && text[0] == '-' && text[1] == '-' && (line_start || syms[START])) {
+      comments++;
+    } else {
+      fprintf(stderr, "FAIL (%s): path in '%s' is %u characters long, was %u\n", name, text, new, old);
+      ok = false;
+    }
+  }
+  if (ok) {
+    printf("%-32s %d strings, %5lu paths, %5lu after a layout token, %3lu comments instead\n", name, CASES, paths,
+      others, comments);
+  }
+  tree_sitter_unison_external_scanner_destroy(scanner);
+  return ok;
+}
+
+static double time_calls(void *scanner, MockLexer *m, const uint32_t *starts, size_t n, bool *syms,
+                         unsigned long *checksum) {
+  m->advances = m->marks = 0;
+  double start = now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (size_t i = 0; i < n; i++) *checksum += new_path_length(scanner, m, starts[i], syms);
+  }
+  return (now_ns() - start) / ((double) ROUNDS * n);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <unison-file>\n", argv[0]);
+    return 1;
+  }
+  regex_t re;
+  if (regcomp(&re, old_path, REG_EXTENDED) != 0) {
+    fprintf(stderr, "the old path regex doesn't compile\n");
+    return 1;
+  }
+  void *scanner = tree_sitter_unison_external_scanner_create();
+  bool syms[FAIL + 1] = {false}, old_syms[FAIL + 1] = {false};
+  syms[PATH] = syms[COMMENT] = true;
+  static const struct { const char *prefix, *name; } contexts[] = {
+    {" ", "inline"},
+    {"\n", "line start"},
+    {"\n  ", "indented line start"},
+  };
+  static const struct { Sym sym; const char *name; } extras[] = {
+    {FAIL, ""},
+    {SEMICOLON, " + semicolon"},
+    {DOT, " + dot"},
+    {END, " + end"},
+    {START, " + start"},
+  };
+  bool ok = true;
+  for (size_t c = 0; c < sizeof(contexts) / sizeof(contexts[0]); c++) {
+    for (size_t e = 0; e < sizeof(extras) / sizeof(extras[0]) && ok; e++) {
+      char name[64];
+      snprintf(name, sizeof(name), "%s%s:", contexts[c].name, extras[e].name);
+      if (extras[e].sym != FAIL) syms[extras[e].sym] = true;
+      ok = fuzz(&re, syms, contexts[c].prefix, name);
+      if (extras[e].sym != FAIL) syms[extras[e].sym] = false;
+    }
+  }
+  regfree(&re);
+  if (!ok) return 1;
+
+  uint32_t length;
+  int32_t *input = mock_read_file(argv[1], &length);
+  uint32_t *starts = calloc(length + 1, sizeof(uint32_t));
+  size_t n = 0;
+  for (uint32_t i = 1; i < length; i++) {
+    bool after = isws(input[i - 1]) || input[i - 1] == '(';
+    if (after && (input[i] == '.' || path_wordy_start(input[i]))) starts[n++] = i;
+  }
+  MockLexer m;
+  mock_lexer_init(&m, input, length);
+  unsigned long checksum = 0, paths = 0;
+  for (size_t i = 0; i < n; i++) paths += new_path_length(scanner, &m, starts[i], syms) > 0;
+  printf("%zu names in %u characters, %lu of them qualified\n", n, length, paths);
+
+  old_syms[COMMENT] = true;
+  double old_ns = time_calls(scanner, &m, starts, n, old_syms, &checksum);
+  double new_ns = time_calls(scanner, &m, starts, n, syms, &checksum);
+  printf("scanner call without PATH: %6.2f ns/name\n", old_ns);
+  printf("scanner call with PATH:    %6.2f ns/name, %5.2f advances/name, %5.2f mark_end/name (%lu)\n", new_ns,
+    (double) m.advances / ((double) ROUNDS * n), (double) m.marks / ((double) ROUNDS * n), checksum % 10);
+
+  tree_sitter_unison_external_scanner_destroy(scanner);
+  free(starts);
+  free(input);
+  return 0;
+}
@@ -0,0 +1,267 @@
+/**
+ * Replay of the scanner calls of a real parse, without the parser.
+ *
+ * Every call recorded by `script/record-scans` is made again at its position, with its valid symbols and the comment
+ * depth and indent stack it started from, so the scanner sees exactly what it saw in the parse, minus the parse tables
+ * and the runtime's lexer. Calls are grouped twice: by the scan path `scan_path` dispatches them to, and by the part of
+ * the scanner that produced their token, told by its symbol (`none` for calls that fail). For each group it reports
+ * the share of the calls, the time per call, and the `advance` and `get_column` calls per scanner call. The time
+ * includes restoring the indent stack, which is a copy of a few words.
+ *
+ * Built with `-DUNISON_SCANNER_STATS`, it also prints the scanner's own counters per symbol for one pass over the
+ * calls, as `tree_sitter_unison_scanner_stats` reports them. Built with `-DUNISON_SCANNER_DECISIONS`, it writes the
+ * decision trace of the last calls of that pass to `decisions.bin`, for `script/decode-decisions`.
+ *
+ * script/generate-corpus.js 2000 > corpus.u && script/record-scans corpus.u > calls.txt
+ * cc -O2 -Isrc -Ibench [-DUNISON_SCANNER_STATS] [-DUNISON_SCANNER_DECISIONS] bench/replay.c -o replay && ./replay corpus.u calls.txt
+ */
+#include "scanner.c"
+#include "mock_lexer.h"
+#include <time.h>
+
+#define ROUNDS 20
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef struct {
+  uint32_t position; // in code points
+  bool syms[FAIL + 1];
+  uint32_t comment_depth;
+  uint32_t indents; // offset into the shared indent array
+  uint32_t indent_count;
+  uint8_t path;
+  uint8_t decided;
+} Call;
+
+typedef struct {
+  unsigned long calls;
+  unsigned long advances;
+  unsigned long column_queries;
+  double ns;
+} Totals;
+
+static const char *path_names[] = {"comment", "recovery", "fold", "doc", "comments", "layout", "operator", "all"};
+
+#define PATH_COUNT (sizeof(path_names) / sizeof(path_names[0]))
+
+static uint8_t path_of(uint32_t valid, uint32_t comment_depth) {
+  if (comment_depth > 0) return 0;
+  if (all_syms(valid)) return 1;
+  ScanPath path = scan_path(valid);
+  return path == scan_fold ? 2 : path == scan_doc ? 3 : path == scan_comments ? 4 : path == scan_layout ? 5
+    : path == scan_operator ? 6 : 7;
+}
+
+static const char *decided_names[] = {"none", "layout_start", "layout_end", "keyword", "hash", "operator", "comment",
+  "doc_block", "fold", "number", "path"};
+
+#define DECIDED_COUNT (sizeof(decided_names) / sizeof(decided_names[0]))
+
+static uint8_t decided_by(Sym sym) {
+  switch (sym) {
+    case START: case START_AND_ARROW: case GUARD_LAYOUT_START: case DESTRUCTURE_START: return 1;
+    case SEMICOLON: case END: case EMPTY: case INDENT: case COMMA: return 2;
+    case WHERE: case IN: return 3;
+    case DOT: case OCTOTHORPE: return 4;
+    case VARSYM: case SYMOP: case PREFIX_SYMOP: case WATCH: return 5;
+    case COMMENT: return 6;
+    case DOC_OPEN: case DOC_TEXT: case DOC_CLOSE: return 7;
+    case FOLD: case FOLD_CONTINUATION: return 8;
+    case NAT: case INT: case FLOAT: case HEX: case BYTES: return 9;
+    case PATH: return 10;
+    default: return 0;
+  }
+}
+
+static uint32_t *indent_data;
+
+/**
+ * Parse the recording. Rows and byte columns are turned into code point offsets with the line starts of the input.
+ */
+static uint32_t read_calls(const char *path, const char *bytes, size_t n, Call **calls_out) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    exit(1);
+  }
+  size_t lines = 1;
+  for (size_t i = 0; i < n; i++) lines += bytes[i] == '\n';
+  uint32_t *line_bytes = malloc(sizeof(uint32_t) * lines), *line_points = malloc(sizeof(uint32_t) * lines);
+  uint32_t *points = malloc(sizeof(uint32_t) * (n + 1));
+  uint32_t line = 0, point = 0;
+  line_bytes[0] = line_points[0] = 0;
+  for (size_t i = 0; i <= n; i++) {
+    points[i] = point;
+    if (i == n) break;
+    if (((unsigned char) bytes[i] & 0xc0) != 0x80) point++;
+    if (bytes[i] == '\n') {
+      line_bytes[++line] = i + 1;
+      line_points[line] = point;
+    }
+  }
+
+  size_t cap = 1024, indent_cap = 1024, indent_len = 0;
+  Call *calls = malloc(sizeof(Call) * cap);
+  indent_data = malloc(sizeof(uint32_t) * indent_cap);
+  uint32_t count = 0;
+  char text[8192];
+  while (fgets(text, sizeof(text), f)) {
+    unsigned row, col, valid, depth;
+    int used;
+    if (sscanf(text, "%u %u %x %u%n", &row, &col, &valid, &depth, &used) != 4) continue;
+    if (count == cap) calls = realloc(calls, sizeof(Call) * (cap *= 2));
+    Call *call = &calls[count++];
+    *call = (Call) {.comment_depth = depth, .indents = indent_len};
+    size_t offset = row < lines ? line_bytes[row] + col : n;
+    call->position = offset <= n ? points[offset] : points[n];
+    for (int s = 0; s <= FAIL; s++) call->syms[s] = valid & SYM_BIT(s);
+    unsigned indent;
+    int more;
+    for (char *p = text + used; sscanf(p, "%u%n", &indent, &more) == 1; p += more) {
+      if (indent_len == indent_cap) indent_data = realloc(indent_data, sizeof(uint32_t) * (indent_cap *= 2));
+      indent_data[indent_len++] = indent;
+      call->indent_count++;
+    }
+    call->path = path_of(valid, depth);
+  }
+  fclose(f);
+  free(line_bytes);
+  free(line_points);
+  free(points);
+  *calls_out = calls;
+  return count;
+}
+
+static bool replay(void *scanner, MockLexer *m, const Call *call) {
+  indent_vec *indents = scanner;
+  VEC_GROW(indents, call->indent_count);
+  memcpy(indents->data, indent_data + call->indents, sizeof(uint32_t) * call->indent_count);
+  indents->len = call->indent_count;
+  indents->comment_depth = call->comment_depth;
+  mock_lexer_seek(m, call->position);
+  return tree_sitter_unison_external_scanner_scan(scanner, &m->lexer, call->syms);
+}
+
+static void report(const char *title, const char **names, size_t count, Totals *totals, unsigned long calls) {
+  printf("\n%-14s %9s %7s %9s %10s %10s\n", title, "calls", "share", "ns/call", "advance", "get_column");
+  for (size_t i = 0; i < count; i++) {
+    Totals *t = &totals[i];
+    if (t->calls == 0) continue;
+    printf("%-14s %9lu %6.2f%% %9.2f %10.2f %10.3f\n", names[i], t->calls, 100.0 * t->calls / calls,
+      t->ns / ((double) ROUNDS * t->calls), (double) t->advances / t->calls, (double) t->column_queries / t->calls);
+  }
+}
+
+#ifdef UNISON_SCANNER_STATS
+static const char *sym_labels[] = {"semicolon", "start", "end", "dot", "where", "varsym", "comment", "fold", "comma",
+  "in", "indent", "empty", "symop", "prefix_symop", "watch", "start_and_arrow", "octothorpe", "doc_open",
+  "guard_layout_start", "destructure_start", "fold_continuation", "doc_close", "doc_text", "nat", "int", "float", "hex",
+  "bytes", "path", "all calls"};
+
+static void report_stats(const TreeSitterUnisonScannerStats *stats) {
+  printf("\n%-19s %9s %9s %9s %11s %9s %9s %7s\n", "symbol", "valid", "produced", "failed", "after error", "advanced",
+    "wasted", "indents");
+  for (Sym s = 0; s <= FAIL; s++) {
+    const TreeSitterUnisonSymbolStats *t = &stats->symbols[s];
+    if (t->calls == 0 && t->successes == 0) continue;
+    printf("%-19s %9lu %9lu %9lu %11lu %9lu %9lu %7u\n", sym_labels[s], (unsigned long) t->calls,
+      (unsigned long) t->successes, (unsigned long) t->failures, (unsigned long) t->after_error,
+      (unsigned long) t->advanced, (unsigned long) t->wasted, t->max_indents);
+  }
+}
+#endif
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <unison-file> <recorded-calls>\n", argv[0]);
+    return 1;
+  }
+  FILE *f = fopen(argv[1], "rb");
+  if (f == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *bytes = malloc(size + 1);
+  size_t n = fread(bytes, 1, size, f);
+  fclose(f);
+  uint32_t length;
+  int32_t *input = mock_decode_utf8(bytes, n, &length);
+  Call *calls;
+  uint32_t count = read_calls(argv[2], bytes, n, &calls);
+  free(bytes);
+  if (count == 0) {
+    fprintf(stderr, "no calls in %s\n", argv[2]);
+    return 1;
+  }
+
+  void *scanner = tree_sitter_unison_external_scanner_create();
+  MockLexer m;
+  mock_lexer_init(&m, input, length);
+  Totals by_path[PATH_COUNT] = {{0}}, by_decided[DECIDED_COUNT] = {{0}};
+  unsigned long advances = 0, column_queries = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    unsigned long a = m.advances, c = m.column_queries;
+    bool found = replay(scanner, &m, &calls[i]);
+    calls[i].decided = found ? decided_by(m.lexer.result_symbol) : 0;
+    Totals *totals[] = {&by_path[calls[i].path], &by_decided[calls[i].decided]};
+    for (int k = 0; k < 2; k++) {
+      totals[k]->calls++;
+      totals[k]->advances += m.advances - a;
+      totals[k]->column_queries += m.column_queries - c;
+    }
+  }
+  advances = m.advances;
+  column_queries = m.column_queries;
+#ifdef UNISON_SCANNER_STATS
+  TreeSitterUnisonScannerStats pass = tree_sitter_unison_scanner_stats();
+#endif
+#ifdef UNISON_SCANNER_DECISIONS
+  uint32_t trace_size = tree_sitter_unison_decision_trace_dump(NULL, 0);
+  char *trace = malloc(trace_size);
+  tree_sitter_unison_decision_trace_dump(trace, trace_size);
+  FILE *out = fopen("decisions.bin", "wb");
+  if (out == NULL || fwrite(trace, 1, trace_size, out) != trace_size) perror("decisions.bin");
+  if (out != NULL) fclose(out);
+  free(trace);
+#endif
+
+  // Each group is timed on its own calls, in the order of the recording, so that no timer runs inside a call.
+  uint32_t *group = malloc(sizeof(uint32_t) * count);
+  for (int by = 0; by < 2; by++) {
+    size_t groups = by == 0 ? PATH_COUNT : DECIDED_COUNT;
+    for (size_t g = 0; g < groups; g++) {
+      uint32_t k = 0;
+      for (uint32_t i = 0; i < count; i++) {
+        if ((by == 0 ? calls[i].path : calls[i].decided) == g) group[k++] = i;
+      }
+      if (k == 0) continue;
+      double start = now_ns();
+      for (int r = 0; r < ROUNDS; r++) {
+        for (uint32_t i = 0; i < k; i++) replay(scanner, &m, &calls[group[i]]);
+      }
+      (by == 0 ? by_path : by_decided)[g].ns = now_ns() - start;
+    }
+  }
+  free(group);
+
+  printf("%u calls in %u characters, %.2f advance/call, %.3f get_column/call\n", count, length,
+    (double) advances / count, (double) column_queries / count);
+  report("scan path", path_names, PATH_COUNT, by_path, count);
+  report("decided by", decided_names, DECIDED_COUNT, by_decided, count);
+#ifdef UNISON_SCANNER_STATS
+  report_stats(&pass);
+#endif
+
+  tree_sitter_unison_external_scanner_destroy(scanner);
+  free(indent_data);
+  free(calls);
+  free(input);
+  return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * Throughput of the external scanner in calls per second.
+ *
+ * Calls the scanner the way the runtime does after each token, with a rotation of valid-symbol sets of the kinds the
+ * parse tables produce and a few layouts on the stack. It runs twice: at every position of the input, and only where
+ * a token can start after whitespace, which is where operators and keywords are scanned.
+ *
+ * script/generate-corpus.js 2000 [shape] > corpus.u
+ * cc -O2 -Isrc -Ibench bench/scan.c -o scan && ./scan corpus.u
+ */
+#include "scanner.c"
+#include "mock_lexer.h"
+#include <time.h>
+
+#define ROUNDS 5
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static const Sym valid_sets[][8] = {
+  {COMMENT, FAIL},
+  {COMMENT, DOC_OPEN, FAIL},
+  {SEMICOLON, END, COMMENT, FAIL},
+  {PREFIX_SYMOP, COMMENT, FAIL},
+  {START, COMMENT, FAIL},
+  {SEMICOLON, END, COMMENT, GUARD_LAYOUT_START, FAIL},
+  {DOT, OCTOTHORPE, COMMENT, FAIL},
+  {SEMICOLON, END, COMMENT, FOLD, WATCH, DOC_OPEN, FAIL},
+};
+#define VALID_SETS (sizeof(valid_sets) / sizeof(valid_sets[0]))
+
+static bool syms[VALID_SETS][FAIL + 1];
+static char buffer[TREE_SITTER_SERIALIZATION_BUFFER_SIZE];
+static unsigned buffer_length;
+
+static void run(const char *name, MockLexer *m, const uint32_t *positions, uint32_t n) {
+  void *scanner = tree_sitter_unison_external_scanner_create();
+  m->advances = m->marks = m->column_queries = 0;
+  unsigned long calls = 0, tokens = 0;
+  double start = now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (uint32_t i = 0; i < n; i++) {
+      tree_sitter_unison_external_scanner_deserialize(scanner, buffer, buffer_length);
+      mock_lexer_seek(m, positions[i]);
+      tokens += tree_sitter_unison_external_scanner_scan(scanner, &m->lexer, syms[i % VALID_SETS]);
+      calls++;
+    }
+  }
+  double ns = now_ns() - start;
+  printf("%s: %lu calls (%lu tokens) in %.1f ms: %.2f M calls/s, %.1f ns/call\n",
+    name, calls, tokens, ns / 1e6, calls / ns * 1e3, ns / calls);
+  printf("  per call: %.3f get_column, %.2f advance, %.2f mark_end\n",
+    (double) m->column_queries / calls, (double) m->advances / calls, (double) m->marks / calls);
+  tree_sitter_unison_external_scanner_destroy(scanner);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <unison-file>\n", argv[0]);
+    return 1;
+  }
+  uint32_t length;
+  int32_t *input = mock_read_file(argv[1], &length);
+  MockLexer m;
+  mock_lexer_init(&m, input, length);
+
+  for (size_t v = 0; v < VALID_SETS; v++) {
+    for (const Sym *s = valid_sets[v]; *s != FAIL; s++) syms[v][*s] = true;
+  }
+
+  indent_vec *layouts = tree_sitter_unison_external_scanner_create();
+  for (uint32_t i = 0; i < 3; i++) {
+    VEC_PUSH(layouts, 2 * i);
+  }
+  buffer_length = tree_sitter_unison_external_scanner_serialize(layouts, buffer);
+  tree_sitter_unison_external_scanner_destroy(layouts);
+
+  uint32_t *positions = calloc(length + 1, sizeof(uint32_t));
+  for (uint32_t i = 0; i < length; i++) positions[i] = i;
+  run("every position", &m, positions, length);
+
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < length; i++) {
+    if (!isws(input[i]) && (i == 0 || isws(input[i - 1]))) positions[n++] = i;
+  }
+  run("token starts", &m, positions, n);
+
+  free(positions);
+  free(input);
+  return 0;
+}
@@ -0,0 +1,252 @@
+/**
+ * Stress test for the serialization of the layout indent stack and the comment depth.
+ *
+ * Checks that stacks with thousands of nested layouts, decreasing indents and columns beyond 16 bits round-trip
+ * exactly, that scanning goes on correctly after a stack too deep for the buffer lost its outer layouts, that cut off
+ * or implausible buffers are not trusted, and measures the cost of the serialize/deserialize pair the runtime performs
+ * around each external token against the memcpy of the old format.
+ *
+ * cc -O2 -Isrc -Ibench bench/serialize.c -o serialize && ./serialize
+ */
+#include "scanner.c"
+#include "mock_lexer.h"
+#include <time.h>
+
+#define ROUNDS 20000
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Nested blocks indented by `step`, with an occasional layout opened further left (e.g. inside parentheses) and an
+ * occasional very long line.
+ */
+static void nested(indent_vec *indents, uint32_t depth, uint32_t step) {
+  indents->len = 0;
+  for (uint32_t i = 0; i < depth; i++) {
+    uint32_t column = i * step;
+    if (i % 7 == 3) column /= 2;
+    if (i % 101 == 50) column += 70000;
+    VEC_PUSH(indents, column);
+  }
+}
+
+/**
+ * The format before version 2: the indents copied as they are, and nothing at all if they don't fit.
+ */
+static unsigned memcpy_serialize(indent_vec *indents, char *buffer) {
+  unsigned size = sizeof(indents->data[0]) * indents->len;
+  if (size > TREE_SITTER_SERIALIZATION_BUFFER_SIZE) return 0;
+  memcpy(buffer, indents->data, size);
+  return size;
+}
+
+static void memcpy_deserialize(indent_vec *indents, const char *buffer, unsigned length) {
+  indents->len = 0;
+  uint32_t count = length / sizeof(indents->data[0]);
+  if (count == 0) return;
+  VEC_GROW(indents, count);
+  memcpy(indents->data, buffer, length);
+  indents->len = count;
+}
+
+static bool same_stack(indent_vec *a, indent_vec *b) {
+  return a->len == b->len && memcmp(a->data, b->data, a->len * sizeof(a->data[0])) == 0;
+}
+
+typedef struct {
+  unsigned ends_before[3]; // layout ends before the semicolon of each line
+  unsigned ends_at_eof;
+} Closes;
+
+/**
+ * Scan a layout-closing input the way the runtime would, with only `SEMICOLON` and `END` valid, starting from the
+ * layouts of `start`, and with the state passed through serialization between tokens if `serialized`. The input is
+ * three lines, the first at column `first`, the second at `second` and the third at column 0; the name on each line
+ * stands for what the grammar lexes after the semicolon. At the end of the file, the parser asks for `END` until all
+ * layouts are closed.
+ */
+static Closes close_layouts(indent_vec *start, bool serialized, uint32_t first, uint32_t second) {
+  char text[8192];
+  int n = snprintf(text, sizeof(text), "\n%*sa\n%*sb\nc\n", (int) first, "", (int) second, "");
+  uint32_t length;
+  int32_t *input = mock_decode_utf8(text, (size_t) n, &length);
+  MockLexer m;
+  mock_lexer_init(&m, input, length);
+  indent_vec *scanner = tree_sitter_unison_external_scanner_create();
+  VEC_GROW(scanner, start->len);
+  memcpy(scanner->data, start->data, start->len * sizeof(start->data[0]));
+  scanner->len = start->len;
+  char buffer[TREE_SITTER_SERIALIZATION_BUFFER_SIZE];
+  unsigned size = tree_sitter_unison_external_scanner_serialize(scanner, buffer);
+  bool syms[FAIL + 1] = {false};
+  syms[SEMICOLON] = syms[END] = true;
+  Closes closes = {{0}, 0};
+  uint32_t position = 0, line = 0;
+  for (;;) {
+    if (serialized) tree_sitter_unison_external_scanner_deserialize(scanner, buffer, size);
+    if (scanner->len == 0 && line == 3) break;
+    mock_lexer_seek(&m, position);
+    if (!tree_sitter_unison_external_scanner_scan(scanner, &m.lexer, syms)) {
+      // Without layouts, there is nothing left for the line to continue.
+      if (scanner->len > 0) printf("FAIL: no layout token at %u\n", position);
+      break;
+    }
+    if (serialized) size = tree_sitter_unison_external_scanner_serialize(scanner, buffer);
+    position = m.marked;
+    if (m.lexer.result_symbol == END) {
+      if (line < 3) closes.ends_before[line]++;
+      else closes.ends_at_eof++;
+      continue;
+    }
+    // The semicolon is zero-width before the line, the name follows it.
+    while (position < length && (input[position] == '\n' || input[position] == ' ')) position++;
+    position++;
+    line++;
+  }
+  tree_sitter_unison_external_scanner_destroy(scanner);
+  free(input);
+  return closes;
+}
+
+/**
+ * Truncation keeps the inner layouts and brings the outer ones back with the column of the outermost kept one. Scanning
+ * after that has to produce the same semicolons and ends as with the whole stack, as long as no line goes back to a
+ * column among the dropped layouts. A line that does ends all the dropped layouts instead of continuing one of them.
+ */
+static int truncation_recovery(void) {
+  indent_vec *whole = tree_sitter_unison_external_scanner_create();
+  const uint32_t depth = 1500, kept_from = 1200;
+  for (uint32_t i = 0; i < depth; i++) {
+    VEC_PUSH(whole, 2 * i + 2);
+  }
+  char buffer[TREE_SITTER_SERIALIZATION_BUFFER_SIZE];
+  unsigned size = tree_sitter_unison_external_scanner_serialize(whole, buffer);
+  unsigned pos = 1;
+  uint64_t comment_depth, omitted = 0;
+  if (varint_read(buffer, size, &pos, &comment_depth)) varint_read(buffer, size, &pos, &omitted);
+  int failures = 0;
+  if (omitted == 0 || omitted > kept_from) {
+    printf("FAIL: %u layouts in %u bytes should lose some but fewer than %u\n", depth, size, kept_from);
+    failures++;
+  }
+
+  const uint32_t innermost = 2 * depth, kept = 2 * kept_from + 2, dropped = 2 * (omitted / 2) + 2;
+  Closes a = close_layouts(whole, false, innermost, kept), b = close_layouts(whole, true, innermost, kept);
+  Closes c = close_layouts(whole, false, innermost, dropped), d = close_layouts(whole, true, innermost, dropped);
+  printf("%u layouts, %u omitted: %u/%u/%u ends before the lines and %u at the end of the file, %u/%u/%u and %u "
+    "after truncation; with the second line among the omitted ones %u/%u/%u and %u, %u/%u/%u and %u after truncation\n",
+    depth, (unsigned) omitted, a.ends_before[0], a.ends_before[1], a.ends_before[2], a.ends_at_eof, b.ends_before[0],
+    b.ends_before[1], b.ends_before[2], b.ends_at_eof, c.ends_before[0], c.ends_before[1], c.ends_before[2],
+    c.ends_at_eof, d.ends_before[0], d.ends_before[1], d.ends_before[2], d.ends_at_eof);
+  if (memcmp(&a, &b, sizeof(a)) != 0 || a.ends_before[1] != depth - kept_from - 1 || a.ends_before[2] != kept_from + 1) {
+    printf("FAIL: scanning after truncation doesn't close the layouts like with the whole stack\n");
+    failures++;
+  }
+  if (c.ends_before[1] != depth - omitted / 2 - 1 || d.ends_before[1] != depth || d.ends_before[2] != 0) {
+    printf("FAIL: a line among the omitted layouts doesn't end all of them\n");
+    failures++;
+  }
+  tree_sitter_unison_external_scanner_destroy(whole);
+  return failures;
+}
+
+int main(void) {
+  indent_vec *indents = tree_sitter_unison_external_scanner_create();
+  indent_vec *copy = tree_sitter_unison_external_scanner_create();
+  char buffer[TREE_SITTER_SERIALIZATION_BUFFER_SIZE];
+  int failures = 0;
+
+  // Exact round trips, up to the deepest stack that fits.
+  uint32_t deepest = 0;
+  for (uint32_t depth = 0; depth <= 5000; depth++) {
+    nested(indents, depth, 2);
+    unsigned length = tree_sitter_unison_external_scanner_serialize(indents, buffer);
+    tree_sitter_unison_external_scanner_deserialize(copy, buffer, length);
+    unsigned pos = 1;
+    uint64_t comment_depth = 0, omitted = 0;
+    if (length > 0 && varint_read(buffer, length, &pos, &comment_depth)) varint_read(buffer, length, &pos, &omitted);
+    bool inner_exact = same_stack(copy, indents);
+    for (uint32_t i = 0; omitted > 0 && i < copy->len; i++) {
+      inner_exact = copy->data[i] == indents->data[i < omitted ? omitted : i];
+      if (!inner_exact) break;
+    }
+    if (!inner_exact) {
+      printf("FAIL: depth %u does not round-trip (%u outer layouts omitted)\n", depth, (unsigned) omitted);
+      failures++;
+    } else if (omitted == 0) {
+      deepest = depth;
+    }
+  }
+  printf("deepest exact stack: %u layouts (raw uint16_t format: %zu)\n", deepest,
+    (size_t) TREE_SITTER_SERIALIZATION_BUFFER_SIZE / sizeof(uint16_t));
+
+  // An empty buffer resets the stack.
+  nested(copy, 10, 2);
+  tree_sitter_unison_external_scanner_deserialize(copy, buffer, 0);
+  if (copy->len != 0) {
+    printf("FAIL: deserializing an empty buffer keeps %u layouts\n", copy->len);
+    failures++;
+  }
+
+  // A buffer that is cut off or claims too many omitted layouts is not trusted.
+  static const char hostile[][12] = {
+    {SERIALIZATION_VERSION, 0, (char) 0x80, (char) 0x80, (char) 0x80, (char) 0x80, 0x10, 2},
+    {SERIALIZATION_VERSION, 0, (char) 0x81, (char) 0x80, 0x04, 2},
+    {SERIALIZATION_VERSION, 0, 0, 2, (char) 0x82},
+    {SERIALIZATION_VERSION, (char) 0x80, (char) 0x80, (char) 0x80, (char) 0x80, 0x10, 0, 2},
+  };
+  static const unsigned hostile_lengths[] = {8, 6, 5, 8};
+  for (size_t i = 0; i < sizeof(hostile) / sizeof(hostile[0]); i++) {
+    nested(copy, 10, 2);
+    tree_sitter_unison_external_scanner_deserialize(copy, (char *) hostile[i], hostile_lengths[i]);
+    if (copy->len != 0 || copy->comment_depth != 0) {
+      printf("FAIL: untrusted buffer %zu comes back as %u layouts\n", i, copy->len);
+      failures++;
+    }
+  }
+
+  // The depth of a comment that continues in the next token is kept, with or without layouts.
+  for (uint32_t depth = 0; depth <= 2; depth++) {
+    nested(indents, depth, 2);
+    indents->comment_depth = 70000;
+    unsigned length = tree_sitter_unison_external_scanner_serialize(indents, buffer);
+    tree_sitter_unison_external_scanner_deserialize(copy, buffer, length);
+    if (copy->comment_depth != 70000 || copy->len != depth) {
+      printf("FAIL: comment depth %u with %u layouts comes back as %u with %u\n", 70000, depth, copy->comment_depth,
+        copy->len);
+      failures++;
+    }
+  }
+  indents->comment_depth = 0;
+
+  failures += truncation_recovery();
+
+  // Cost per token, against the memcpy of the old format.
+  static const uint32_t depths[] = {4, 32, 256, 1000, 4000};
+  for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+    nested(indents, depths[d], 2);
+    unsigned length = 0, old_length = 0;
+    double start = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+      length = tree_sitter_unison_external_scanner_serialize(indents, buffer);
+      tree_sitter_unison_external_scanner_deserialize(copy, buffer, length);
+    }
+    double ns = (now_ns() - start) / ROUNDS;
+    start = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+      old_length = memcpy_serialize(indents, buffer);
+      memcpy_deserialize(copy, buffer, old_length);
+    }
+    double old_ns = (now_ns() - start) / ROUNDS;
+    printf("depth %5u: %4u bytes, %8.1f ns per serialize + deserialize; memcpy: %4u bytes, %6.1f ns\n", depths[d],
+      length, ns, old_length, old_ns);
+  }
+
+  tree_sitter_unison_external_scanner_destroy(indents);
+  tree_sitter_unison_external_scanner_destroy(copy);
+  return failures == 0 ? 0 : 1;
+}
@@ -4,24 +4,26 @@ const useClause = require("./grammar/use-clause");
 const identifiers = require("./grammar/identifier");
 const reserved = require("./grammar/reserved");
 const watch = require("./grammar/watch");
+const docs = require("./grammar/doc");
 const externals = require("./grammar/externals");
 const conflicts = require("./grammar/conflicts");
 
 module.exports = grammar({
   name: "unison",
   precedences: ($) => [
-    ["_expression", "identifier"],
-    ["term_definition", "_expression"],
-    ["keyword", "_expression"],
     ["function_application", "operator"], // `myFn a b + c` is equivalent to `((myFn a) b) + c`
     ["_infix_op_application", "_prefix_function_application"],
     ["literal_function", "function_application"],
-    ["_boolean_exp", "literal_function"],
     ["constructor_or_variable_pattern", "_lhs"],
   ],
   conflicts,
   externals,
-  extras: ($) => [/\\?\s/, $.comment],
+  // Anonymous patterns in `extras` are separators, which the lexer skips without producing a token. A backslash is only
+  // skipped before a line break, so that `\` stays an operator everywhere else.
+  extras: ($) => [/\s/, /\\\r?\n/, $.comment],
+  // Reserved words like `match`, `cases` and `true` are lexed as a `wordy_id` and then looked up in a small keyword
+  // table, instead of each being a separate competitor of `wordy_id` in the main lexer.
+  word: ($) => $.wordy_id,
   rules: {
     unison: ($) =>
       repeat(
@@ -37,11 +39,14 @@ module.exports = grammar({
           alias($.effect_declaration, $.ability_declaration),
         ),
       ),
+    // Everything after a `---` line, scanned in chunks so that incremental parsing can reuse most of a long fold.
+    fold: ($) => seq($._fold, repeat($._fold_continuation)),
     ...bindings,
     ...types,
     ...useClause,
     ...reserved,
     ...identifiers,
     ...watch,
+    ...docs,
   },
 });
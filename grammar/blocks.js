@@ -5,8 +5,6 @@ const { sep, layouted, layoutBlock } = require("./util");
 module.exports = {
   ...funcApp,
 
-  operator_expression: ($) => seq($._expression, alias($.symboly_id, $.operator), $._expression),
-
   _block: ($) => layouted($, $._statement),
 
   // let [sm_1] [sm_2] ... [sm_n] [exp]
@@ -1,4 +1,7 @@
 module.exports = {
-  doc_block: ($) => "TODO",
-  doc2_block: ($) => "TODO 2",
+  // The scanner splits the contents into line-sized `_doc_text` chunks, so that an edit in a long doc block only
+  // re-lexes the lines around it.
+  doc_block: ($) => seq($._doc_open, repeat($._doc_content), $._doc_close),
+  _doc_content: ($) => choice($._doc_text, $._doc_nested),
+  _doc_nested: ($) => seq($._doc_open, repeat($._doc_content), $._doc_close),
 };
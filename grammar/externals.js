@@ -6,7 +6,7 @@ module.exports = ($) => [
   $._where,
   $._varsym,
   $.comment,
-  $.fold,
+  $._fold,
   $._comma,
   $._in,
   $._indent,
@@ -16,9 +16,18 @@ module.exports = ($) => [
   $._watch_start,
   $._start_before_arrow,
   $.hash_cid,
-  $.doc_block,
+  $._doc_open,
   $._guard_layout_start, // This is required because otherwise TS can't tell the difference between PATTERNLEAF *(INFIX PATTERN LEAF) . PATTERN_RHS and PATTERNLEAF . PATTERN_RHS and greedily consumes a 0-width space after the first leaf as LAYOUT_START (proceeding to a failing typeguard path) and refuses to backtrack and try the *(INFIX PATTERNLEAF) path
   $._destructuring_bind_start,
+  $._fold_continuation,
+  $._doc_close,
+  $._doc_text,
+  $.nat,
+  $.int,
+  $.float,
+  $.literal_hex,
+  $.literal_byte,
+  $.path,
   $.DUMMY,
   // $.pipe, // This is required in conjunction with GUARD_LAYOUT_START
 ];
@@ -2,7 +2,7 @@ const regex = require("./regex");
 const { parens, paren$ } = require("./util");
 
 module.exports = {
-  wordy_id: ($) => prec.right(regex.varid),
+  wordy_id: ($) => regex.varid,
   imm_wordy_id: ($) => token.immediate(regex.varid),
 
   symboly_id: ($) => regex.symboly_id,
@@ -29,7 +29,7 @@ module.exports = {
       alias($.symboly_id, $.operator),
     ),
 
-  path: ($) => regex.path,
+  // `path` is an external, lexed by `path` and `symbolic_run` in `src/scanner.c`.
 
   hash_qualifier: ($) =>
     seq(
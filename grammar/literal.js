@@ -2,50 +2,29 @@ const { sep, sep1 } = require("./util");
 const regex = require("./regex");
 
 module.exports = {
-  _literal: ($) =>
-    choice(
-      $.literal_text,
-      $.nat,
-      $.int,
-      $.float,
-      $.literal_char,
-      $.literal_boolean,
-      $.literal_byte,
-      $.literal_hex,
-      // $.literal_hash,
-      $.literal_list,
-      $.literal_function,
-      $.tuple_or_parenthesized,
-      $.literal_termlink,
-      $.literal_typelink,
-      $.unit,
-    ),
   unit: ($) => "()",
   // literal_text: $ => /".+?"/,
 
-  nat: ($) => /[0-9]+/,
-  int: ($) => /[+-][0-9]+/,
-  float: ($) => /[-+]?[0-9]*\.?[0-9]+([eE][-+]?[0-9]+)?/,
+  // `nat`, `int`, `float`, `literal_hex` and `literal_byte` are externals, lexed and range checked by `number` in
+  // `src/scanner.c`.
 
+  // A single token, so that a string doesn't become a leaf per character. Inside `"""`, up to two quotes in a row are
+  // part of the text.
   literal_text: (_) =>
-    choice(
-      // /"(?:\\"|.)*?"/, // <-- this fails for the one line if/else test by parsing a longer string than it should
-      seq('"', repeat(choice(/[^\\"\n]/, /\\(\^)?./, /\\\n\s*\\/)), '"'),
-      seq(
-        '"""',
-        repeat(choice('"', /[^\\"\n]/, /\\(\^)?./, /\\\n\s*\\/)),
-        '"""',
+    token(
+      choice(
+        // /"(?:\\"|.)*?"/, // <-- this fails for the one line if/else test by parsing a longer string than it should
+        seq('"', repeat(choice(/[^\\"\n]/, /\\(\^)?./, /\\\n\s*\\/)), '"'),
+        seq(
+          '"""',
+          repeat(choice(/"{0,2}[^\\"]/, /"{0,2}\\(\^)?./, /"{0,2}\\\n\s*\\/)),
+          '"""',
+        ),
       ),
     ),
 
-  // Range: [0, 18446744073709551615]
-
-  // Range: [-9223372036854775808, 9223372036854775807]
-
   literal_char: ($) => choice(/\?./u, /\?\\[0abfnrtvs\'"]/),
   literal_boolean: ($) => choice("true", "false"),
-  literal_byte: ($) => /0xs[0-9a-fA-F]+/,
-  literal_hex: ($) => /0x[0-9a-fA-F]+/,
   // _term_definition_hash: $ => /#[0-9a-v]+/,
   // _cyclically_recursive_hash: $ => /#[0-9a-v]+\.[0-9a-v]+/,
   // _data_constructor_hash: $ => /#[0-9a-v]+#[0-9a-v]+/,
@@ -0,0 +1,91 @@
+#!/usr/bin/env node
+
+// Render a decision trace of the external scanner as text or as JSON.
+//
+// Usage: script/decode-decisions.js [--json] trace.bin
+//
+// The trace is what `tree_sitter_unison_decision_trace_dump` writes in a scanner built with
+// `-DUNISON_SCANNER_DECISIONS`; see the format there. Text is one line per call, oldest first:
+//
+//   call  lookahead  indents  path  symbol  decider  length  valid symbols
+//
+// with the lookahead quoted, `fail` as the symbol and `-` as the decider of a call that produced no token, `other` as
+// the decider of a token whose decider didn't fit into the scanner's table, and the spaces in a decider replaced by
+// underscores. JSON is an object with the number of calls and an array of the recorded ones, with `null` for the
+// lookahead at the end of the file and for the decider of a failure.
+
+const fs = require('fs')
+
+// In the order of `Sym` in src/scanner.c.
+const syms = ['semicolon', 'start', 'end', 'dot', 'where', 'varsym', 'comment', 'fold', 'comma', 'in', 'indent',
+  'empty', 'symop', 'prefix_symop', 'watch', 'start_and_arrow', 'octothorpe', 'doc_open', 'guard_layout_start',
+  'destructure_start', 'fold_continuation', 'doc_close', 'doc_text', 'nat', 'int', 'float', 'hex', 'bytes', 'path',
+  'fail']
+
+// In the order of `decision_paths` in src/scanner.c.
+const paths = ['comment', 'recovery', 'fold', 'doc', 'comments', 'layout', 'operator', 'all']
+
+const fail = syms.indexOf('fail')
+
+const args = process.argv.slice(2)
+const json = args[0] === '--json'
+const file = json ? args[1] : args[0]
+if (!file) {
+  console.error('Usage: script/decode-decisions.js [--json] trace.bin')
+  process.exit(1)
+}
+
+const data = fs.readFileSync(file)
+if (data.length < 14 || data.toString('latin1', 0, 4) !== 'UNDT') {
+  console.error(`${file} is not a decision trace`)
+  process.exit(1)
+}
+if (data[4] !== 1) {
+  console.error(`${file} has version ${data[4]}, expected 1`)
+  process.exit(1)
+}
+
+const calls = data.readUInt32LE(6)
+const count = data.readUInt32LE(10)
+const deciders = []
+let pos = 14
+for (let i = 0; i < data[5]; i++) {
+  const slot = data[pos]
+  const length = data[pos + 1]
+  deciders[slot] = data.toString('latin1', pos + 2, pos + 2 + length)
+  pos += 2 + length
+}
+
+const validNames = (valid) => {
+  if (valid === 2 ** syms.length - 1) return ['all']
+  return syms.filter((_, i) => valid & (1 << i))
+}
+
+const records = []
+for (let i = 0; i < count; i++, pos += 16) {
+  const lookahead = data.readUInt32LE(pos + 8)
+  const decision = data.readUInt16LE(pos + 14)
+  records.push({
+    call: data.readUInt32LE(pos),
+    lookahead: (lookahead & 0x1fffff) === 0 ? null : String.fromCodePoint(lookahead & 0x1fffff),
+    indents: lookahead >>> 21,
+    path: paths[(decision >> 5) & 7],
+    symbol: syms[decision & 31],
+    decider: decision >> 8 !== 0 ? deciders[decision >> 8] ?? `#${decision >> 8}` : (decision & 31) === fail ? null
+      : 'other',
+    length: data.readUInt16LE(pos + 12),
+    valid: validNames(data.readUInt32LE(pos + 4)),
+  })
+}
+
+if (json) {
+  console.log(JSON.stringify({ calls, records }, null, 2))
+} else {
+  console.log(`${calls} calls, the last ${count} of them recorded`)
+  for (const r of records) {
+    const lookahead = r.lookahead === null ? 'EOF' : JSON.stringify(r.lookahead)
+    const decider = (r.decider ?? '-').replace(/ /g, '_')
+    console.log([String(r.call).padStart(9), lookahead.padEnd(6), String(r.indents).padStart(3), r.path.padEnd(8),
+      r.symbol.padEnd(18), decider.padEnd(24), String(r.length).padStart(5), r.valid.join(' ')].join(' '))
+  }
+}
@@ -0,0 +1,234 @@
+#!/usr/bin/env node
+
+// Generate a large synthetic Unison file for benchmarking the parser and scanner.
+//
+// Usage: script/generate-corpus.js [definitions] [shape] > corpus.u
+//
+// Shapes:
+//   mixed      - a rotation of term declarations using match, let, handle, docs, operators and abilities (default)
+//   long-lines - one ~10k character line of chained operators per definition
+//   keywords   - nested let/match/handle/if blocks, dense in `where`, `with`, `in`, `then` and `else`
+//   operators  - combinator-style definitions built from custom infix operators, as in parser or vector DSLs
+//   strings    - long text literals with escapes, and embedded data in multiline """ literals
+//   numbers    - lookup tables and test vectors of Nat, Int, Float, hex and Bytes literals, and a few literals out of range
+//   qualified  - fully qualified and absolute names of functions, types and operators
+//   indented   - let and match blocks nested ten levels deep, with 80 columns of indentation at the bottom
+//   stress     - mostly the mixed templates, with nested keyword blocks, deep indentation, docs of fifty lines and,
+//                for every 1000th definition, a long line; used by script/bench-parse
+
+const definitions = parseInt(process.argv[2] || '10000', 10)
+const shape = process.argv[3] || 'mixed'
+
+const templates = [
+  (i) => `
+{{ Adds ${i} to the argument. }}
+addN${i} : Nat -> Nat
+addN${i} n = n + ${i}
+`,
+  (i) => `
+fib${i} : Nat -> Nat
+fib${i} = cases
+  0 -> 0
+  1 -> 1
+  n -> fib${i} (n - 1) + fib${i} (n - 2)
+`,
+  (i) => `
+sumPairs${i} xs =
+  let
+    a = List.size xs
+    b = a * ${i}
+    c = b / 2
+    a + b + c
+`,
+  (i) => `
+classify${i} x = match x with
+  Some y | y > ${i} -> "big"
+  Some y -> "small"
+  None -> "none"
+`,
+  (i) => `
+runState${i} : s -> '{State s} a -> a
+runState${i} s prog =
+  h s = cases
+    { get -> k } -> handle k s with h s
+    { put s' -> k } -> handle k () with h s'
+    { a } -> a
+  handle !prog with h s
+`,
+  (i) => `
+unique type Shape${i} = Circle Float | Rect Float Float
+`,
+  (i) => `
+check${i} = if ${i} > 10 then "large" else "small"
+`,
+  (i) => `
+pipeline${i} xs = xs |> List.map (x -> x * ${i}) |> List.filter (x -> x > 3) |> List.foldLeft (+) 0
+`,
+]
+
+const operators = ['+', '+++', '<|>', '>>=', '*', '<>', '++', '-']
+
+const longLine = (i) => {
+  const terms = [`chain${i} =`, 'x0']
+  for (let j = 1; terms.join(' ').length < 10000; j++) {
+    terms.push(operators[j % operators.length], `x${j}`)
+  }
+  return `\n${terms.join(' ')}\n`
+}
+
+const keywords = (i) => `
+structural ability Ask${i} where
+  ask : Nat
+  abort : x
+
+interpret${i} : '{Ask Nat, Abort} a -> Optional a
+interpret${i} prog =
+  go n = cases
+    { ask -> k } -> handle k n with go (n + ${i})
+    { abort -> _ } -> None
+    { a } -> Some a
+  let
+    width = if ${i} > 10 then 10 else ${i}
+    inner = let
+      item = match width with
+        0 -> if isEven width then 1 else 2
+        n -> handle n with go n
+      item
+    in inner
+  handle !prog with go width
+`
+
+const infixOperators = [
+  '<+>', '<*>', '*>', '>>=', '=<<', '<$>', '<|>', '|+|', ':+:', '<.>', '==>', '<~>', '^^^', '&&&', '***', '+++',
+  '<<<', '>>>', '%%', '<=>',
+]
+
+const operatorDense = (i) => {
+  const op = (k) => infixOperators[(i + k) % infixOperators.length]
+  return `
+combine${i} : Expr -> Expr -> Expr
+combine${i} a b = a ${op(0)} b ${op(1)} (a ${op(2)} b) ${op(3)} a ${op(4)} (b ${op(5)} a) ${op(6)} b
+
+step${i} x = x ${op(7)} lit ${i} ${op(8)} (x ${op(9)} x) ${op(10)} x ${op(11)} x ${op(12)} lit 0 ${op(13)} x
+`
+}
+
+const prose = ['lorem', 'ipsum', 'dolor', 'sit', 'amet', '\\"quoted\\"', 'tab\\t', 'caret\\^A', 'a,b;c', '{x}']
+
+const strings = (i) => {
+  const words = (n) => Array.from({ length: n }, (_, k) => prose[(i + k * 7) % prose.length]).join(' ')
+  const rows = Array.from({ length: 40 }, (_, k) => `  ${k},${i * k},"${words(6)}",${k % 3 === 0}`)
+  return `
+message${i} : Text
+message${i} = "${words(300)}"
+
+data${i} : Text
+data${i} = """
+  id,value,label,flag
+${rows.join('\n')}
+  """
+`
+}
+
+const numbers = (i) => {
+  const row = (k) => {
+    const n = (i * 7919 + k * 104729) % 1000003
+    return `(${n}, ${k % 2 ? '-' : '+'}${n * 31}, ${(n / 1000).toFixed(3)}, 0x${n.toString(16)}, 0xs${(n * 257).toString(16).padStart(8, '0')})`
+  }
+  return `
+table${i} : [(Nat, Int, Float, Nat, Bytes)]
+table${i} = [
+  ${Array.from({ length: 32 }, (_, k) => row(k)).join(',\n  ')}
+  ]
+
+vector${i} = scale${i} (-${i}) 1.5e-3 .${i}5 -.5e${i % 4} 18446744073709551615 -9223372036854775808 0xFFFFFFFFFFFFFFFF
+${i % 8 === 0 ? overflow(i) : ''}`
+}
+
+// Literals just out of range, which the scanner rejects, so a parse of the `numbers` shape has errors.
+const overflow = (i) => `
+overflow${i} = [18446744073709551616, +9223372036854775808, -9223372036854775809, 0x1${'0'.repeat(16 + (i % 3))}]
+`
+
+const namespaces = ['base.data.List', 'base.Nat', 'lib.base.data.Map', 'Text', 'io.IO', 'base.Int.Ops']
+const members = ['map', 'foldLeft', 'size', 'insert', '+', '==', '<|>', '++']
+
+const qualified = (i) => {
+  const name = (k) => `${k % 5 === 0 ? '.' : ''}${namespaces[(i + k) % namespaces.length]}.${members[(i * 3 + k) % members.length]}`
+  const term = (k) => (/^[a-z]/.test(members[(i * 3 + k) % members.length]) ? name(k) : `(${name(k)})`)
+  return `
+use${i} : base.data.List.List base.Nat.Nat -> base.Optional.Optional lib.Map.Map
+use${i} xs = ${term(0)} ${term(1)} (${term(2)} xs ${term(3)}) ${term(4)} xs ${term(5)} ${term(6)} (${term(7)} 0)
+`
+}
+
+const indented = (i) => {
+  const lines = [`nested${i} x =`]
+  for (let depth = 1; depth <= 10; depth++) {
+    const indent = ' '.repeat(8 * depth)
+    lines.push(`${indent}let`, `${indent}    y${depth} = x + ${depth}`, `${indent}    z${depth} = y${depth} * ${i}`)
+    lines.push(`${indent}    match z${depth} with`, `${indent}      0 -> y${depth}`, `${indent}      n ->`)
+  }
+  lines.push(`${' '.repeat(88)}n + x`)
+  return `\n${lines.join('\n')}\n`
+}
+
+const bigDoc = (i) => {
+  const paragraph = (k) => Array.from({ length: 12 }, (_, w) => members[(i + k + w * 3) % members.length]).join(' ')
+  const sections = Array.from({ length: 4 }, (_, k) => `
+  # Section ${k} of {{ nested docs {{ ${i} }} }}
+
+  ${paragraph(k)}
+  ${paragraph(k + 1)} {Links} and \`inline\` code.
+
+  * ${paragraph(k + 2)}
+  * @source{step${i}} @signature{step${i}}
+
+  \`\`\`
+  step${i} (x + ${k}) |> List.map (y -> y * ${k})
+  \`\`\``)
+  return `
+{{${sections.join('\n')}
+}}
+step${i} x = x + ${i}
+`
+}
+
+const stress = (i) => {
+  if (i % 1000 === 999) return longLine(i)
+  switch (i % 16) {
+    case 0:
+    case 8:
+      return keywords(i)
+    case 4:
+      return indented(i)
+    case 12:
+      return bigDoc(i)
+    default:
+      return templates[i % templates.length](i)
+  }
+}
+
+const shapes = {
+  mixed: (i) => templates[i % templates.length](i),
+  'long-lines': longLine,
+  keywords,
+  operators: operatorDense,
+  strings,
+  numbers,
+  qualified,
+  indented,
+  stress,
+}
+
+const generate = shapes[shape]
+if (!generate) {
+  console.error(`Unknown shape '${shape}', expected one of: ${Object.keys(shapes).join(', ')}`)
+  process.exit(1)
+}
+
+const chunks = []
+for (let i = 0; i < definitions; i++) {
+  chunks.push(generate(i))
+}
+process.stdout.write(chunks.join(''))
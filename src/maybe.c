@@ -4,7 +4,8 @@
  */
 
 #include <stdbool.h>
-#include <stdlib.h>
+#include <stdint.h>
+#include "tree_sitter/alloc.h"
 
 typedef struct {
     bool has_value;
@@ -12,7 +13,7 @@ typedef struct {
 } Maybe;
 
 void * just(void * a) {
-    Maybe * result = (Maybe *)malloc(sizeof(Maybe));
+    Maybe * result = (Maybe *)ts_malloc(sizeof(Maybe));
     result->has_value = true;
     result->value = a;
     return result;
@@ -22,8 +23,8 @@ Maybe nothing = { false, 0 };
 
 void freeJust(Maybe* a) {
     if (a->has_value) {
-        free(a->value);
-        free(a);
+        ts_free(a->value);
+        ts_free(a);
     }
 }
 
@@ -32,19 +33,19 @@ bool isJust(Maybe* a) {
 }
 
 void * justDouble(double d) {
-    double * it = (double *) malloc(sizeof(double));
+    double * it = (double *) ts_malloc(sizeof(double));
     *it = d;
     return just(it);
 }
 
 void * justLong(long l) {
-    long * it = (long *) malloc(sizeof(long));
+    long * it = (long *) ts_malloc(sizeof(long));
     *it = l;
     return just(it);
 }
 
 void * justInt64(int64_t i) {
-    int64_t * it = (int64_t *) malloc(sizeof(int64_t));
+    int64_t * it = (int64_t *) ts_malloc(sizeof(int64_t));
     *it = i;
     return just(it);
 }
\ No newline at end of file
@@ -1,11 +1,26 @@
 /**
  * Print input and result information.
+ *
+ * The scanner has two build profiles:
+ *  - release (the default): `LOG`, `debug_*` and the `MARK` bookkeeping compile to nothing, arguments included, so
+ *    nothing like `get_column` is evaluated just to be thrown away.
+ *  - trace: build with `-DUNISON_SCANNER_TRACE` (e.g. `CFLAGS=-DUNISON_SCANNER_TRACE tree-sitter test`) to compile the
+ *    diagnostics in. `LOG_LEVEL` then decides what is printed to stderr. Ignored for WASM builds (Zed).
+ * Independently of these, `-DUNISON_SCANNER_DECISIONS` keeps a binary record of the last calls in memory (see
+ * `decision_note`), which is cheap enough for production and can be dumped when a parse goes wrong.
  */
 #include <stdint.h>
-#ifndef __wasm32__ // disable logging for Zed build
+#if defined(UNISON_SCANNER_TRACE) && !defined(__wasm32__)
+#define DEBUG 1
+#else
 #define DEBUG 0
 #endif
 
+// The statistics and the decision trace both need the characters a call advanced over.
+#if defined(UNISON_SCANNER_STATS) || defined(UNISON_SCANNER_DECISIONS)
+#define COUNT_ADVANCES 1
+#endif
+
 #define LOG_LEVEL ERROR
 typedef enum {
   VERBOSE,
@@ -16,12 +31,12 @@ typedef enum {
 } LogLevel;
 
 #include "tree_sitter/parser.h"
-#include <stdlib.h> // malloc, free, calloc
+#include "tree_sitter/alloc.h" // ts_malloc, ts_calloc, ts_realloc, ts_free
+#include "tree_sitter/unison.h" // the diagnostics declared for embedders
 #include <stdio.h> // fprintf, stderr
 #include <assert.h> // assert
 #include <string.h> // memcpy, strlen, strncat
-#include <ctype.h> // isalpha, isdigit
-// #include "jtckdint.h" // needed to prevent integer overflow in get_whole
+#include "jtckdint.h" // ckd_add, ckd_mul
 //#include "maybe.c"
 
 // #ifndef __wasm32__
@@ -44,39 +59,44 @@ typedef enum {
 // Short circuit
 #define SHORT_SCANNER if (res.finished) return res;
 #define PEEK state->lexer->lookahead
-#define COL state->lexer->get_column(state->lexer)
+#define COL current_column(state)
 // Move the parser position one character to the right.
-#define S_ADVANCE state->lexer->advance(state->lexer, false)
-#define S_SKIP state->lexer->advance(state->lexer, true)
-#define SYM(s) (state->symbols[s])
+#define S_ADVANCE advance(state, false)
+#define S_SKIP advance(state, true)
+#define SYM(s) (state->valid & SYM_BIT(s))
 
-#ifndef __wasm32__
+#if DEBUG
 #define LOG(level, format, ...) \
   do { \
     if ((level) >= LOG_LEVEL) { \
       fprintf(stderr, format, ##__VA_ARGS__); \
     } \
   } while(0)
+#define DEBUG_PRINTF(...) do{ fprintf( stderr, __VA_ARGS__ ); } while( false )
 #else
 #define LOG(level, format, ...) \
   do {} while (0)
-#endif
-
-#ifdef DEBUG
-  #ifndef __wasm32__
-  #define DEBUG_PRINTF(...) do{ fprintf( stderr, __VA_ARGS__ ); } while( false )
-  #else
-  #define DEBUG_PRINTF(...) do{ } while ( false )
-  #endif
-#else
 #define DEBUG_PRINTF(...) do{ } while ( false )
 #endif
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 
+/**
+ * Vectors start out on their inline storage and only move to the heap once they outgrow it.
+ * All memory goes through tree-sitter's allocator hooks, so embedders that install their own allocator see every byte.
+ */
 #define VEC_RESIZE(vec, _cap) \
-  (vec)->data = realloc((vec)->data, (_cap) * sizeof((vec)->data[0])); \
-  assert((vec)->data != NULL); \
+  if ((vec)->data == (vec)->inline_data) { \
+    (vec)->data = ts_malloc((_cap) * sizeof((vec)->data[0])); \
+    assert((vec)->data != NULL); \
+    memcpy((vec)->data, (vec)->inline_data, (vec)->len * sizeof((vec)->data[0])); \
+    ALLOC_NOTE((vec), 0, (_cap) * sizeof((vec)->data[0])); \
+  } else { \
+    (vec)->data = ts_realloc((vec)->data, (_cap) * sizeof((vec)->data[0])); \
+    assert((vec)->data != NULL); \
+    ALLOC_NOTE((vec), (vec)->cap * sizeof((vec)->data[0]), (_cap) * sizeof((vec)->data[0])); \
+  } \
   (vec)->cap = (_cap);
 
 #define VEC_GROW(vec, _cap) if ((vec)->cap < (_cap)) { VEC_RESIZE((vec), (_cap)); }\
@@ -89,7 +109,7 @@ typedef enum {
 
 #define VEC_BACK(vec) ((vec)->data[(vec)->len - 1])
 
-#define VEC_FREE(vec) { if ((vec)->data != NULL) free((vec)->data); }
+#define VEC_FREE(vec) { if ((vec)->data != (vec)->inline_data) ts_free((vec)->data); }
 
 // ---------
 // Symbols
@@ -113,13 +133,34 @@ typedef enum {
     WATCH,
     START_AND_ARROW,
     OCTOTHORPE,
-    DOC_BLOCK,
+    DOC_OPEN,
     GUARD_LAYOUT_START,
     DESTRUCTURE_START,
+    FOLD_CONTINUATION,
+    DOC_CLOSE,
+    DOC_TEXT,
+    NAT,
+    INT,
+    FLOAT,
+    HEX,
+    BYTES,
+    PATH,
     FAIL, // always last in list
 } Sym;
 
-// #ifdef DEBUG
+/**
+ * The valid symbols are packed into a bitmask once per call, so that checking a whole set of them is a single test.
+ */
+#define SYM_BIT(s) (1u << (s))
+#define ALL_SYMS ((SYM_BIT(FAIL) << 1) - 1)
+
+static uint32_t valid_symbols(const bool *syms) {
+  uint32_t valid = 0;
+  for (int i = 0; i <= FAIL; i++) valid |= (uint32_t) syms[i] << i;
+  return valid;
+}
+
+#if DEBUG
 static char *sym_names[] = {
     "semicolon",
     "start",
@@ -141,34 +182,38 @@ static char *sym_names[] = {
     "doc block",
     "guard layout start",
     "destructure start",
+    "fold continuation",
+    "doc close",
+    "doc text",
+    "nat",
+    "int",
+    "float",
+    "hex",
+    "bytes",
+    "path",
     "fail",
 };
-// #endif
+#endif
 
 /**
  * The parser appears to call `scan` with all symbols declared as valid directly after it encountered an error, so
  * this function is used to detect them.
  */
-static bool all_syms(const bool *syms) {
-  for (int i = 0; i <= FAIL; i++) {
-    if (!syms[i]) return false;
-  }
-  return true;
-}
+static bool all_syms(uint32_t valid) { return valid == ALL_SYMS; }
 
-#ifdef DEBUG
+#if DEBUG
 /**
  * Produce a comma-separated string of valid symbols.
  */
-static void debug_valid(const bool *syms) {
-  if (all_syms(syms)) {
+static void debug_valid(uint32_t valid) {
+  if (all_syms(valid)) {
     LOG(VERBOSE, "all");
     return;
   }
   bool fst = true;
   LOG(VERBOSE, "\"");
   for (Sym i = SEMICOLON; i < FAIL; i++) {
-    if (syms[i]) {
+    if (valid & SYM_BIT(i)) {
       if (!fst) LOG(VERBOSE, ",");
       LOG(VERBOSE, "%s", sym_names[i]);
       fst = false;
@@ -178,13 +223,46 @@ static void debug_valid(const bool *syms) {
 }
 #endif
 
+/**
+ * Layouts nested deeper than this are rare enough to live on the heap.
+ */
+#define INDENT_INLINE_CAPACITY 64
+
 // State
 typedef struct {
     uint32_t len;
     uint32_t cap;
-    uint16_t *data;
+    uint32_t *data; // `inline_data` until the stack outgrows it
+    uint32_t inline_data[INDENT_INLINE_CAPACITY];
+    // One more than the nesting level of the multiline comment the last token ended in, 0 outside of comments (see
+    // `comment_chunk`). A comment can't nest deeper than half its length, so 32 bits can't overflow.
+    uint32_t comment_depth;
+#ifdef UNISON_SCANNER_ALLOC_STATS
+    TreeSitterUnisonAllocations allocations; // of this scanner, see `tree_sitter_unison_external_scanner_allocations`
+#endif
 } indent_vec;
 
+#ifdef UNISON_SCANNER_ALLOC_STATS
+/**
+ * The allocations of all scanners, see `tree_sitter_unison_scanner_allocations`.
+ */
+static TreeSitterUnisonAllocations scanner_allocations;
+
+static void allocations_add(TreeSitterUnisonAllocations *allocations, uint64_t old_size, uint64_t new_size) {
+  allocations->calls++;
+  allocations->bytes += new_size - old_size;
+  allocations->peak = MAX(allocations->peak, allocations->bytes);
+}
+
+static void alloc_note(TreeSitterUnisonAllocations *allocations, uint64_t old_size, uint64_t new_size) {
+  allocations_add(allocations, old_size, new_size);
+  allocations_add(&scanner_allocations, old_size, new_size);
+}
+#define ALLOC_NOTE(vec, old_size, new_size) alloc_note(&(vec)->allocations, (old_size), (new_size))
+#else
+#define ALLOC_NOTE(vec, old_size, new_size) do {} while (0)
+#endif
+
 // --------------------------------------------------------------------------------------------------------
 // State
 // --------------------------------------------------------------------------------------------------------
@@ -199,29 +277,79 @@ typedef struct {
  */
 typedef struct {
     TSLexer *lexer;
-    const bool *symbols;
+    uint32_t valid; // see `SYM_BIT`
     indent_vec *indents;
-#ifdef DEBUG
+    /**
+     * `get_column` walks back to the start of the line in the tree-sitter runtime, so it is asked at most once per
+     * scan; after that, `advance` keeps the column up to date.
+     * It is only asked lazily, since a token that queried the column is harder for incremental parsing to reuse.
+     */
+    uint32_t column;
+    bool column_known;
+#ifdef COUNT_ADVANCES
+    uint32_t advanced; // characters advanced over in this call, skipped ones included
+    uint32_t advanced_at_mark; // `advanced` at the last `mark_end`, `UINT32_MAX` before the first
+#endif
+#ifdef UNISON_SCANNER_DECISIONS
+    const char *decided_by; // see `Result`
+#endif
+#if DEBUG
     int marked;
     char *marked_by;
     bool needs_free;
+    unsigned column_queries;
 #endif
 } State;
 
 static State state_new(TSLexer *l, const bool * restrict vs, indent_vec *is) {
   return (State) {
     .lexer = l,
-    .symbols = vs,
+    .valid = valid_symbols(vs),
     .indents = is,
-#ifdef DEBUG
+    .column = 0,
+    .column_known = false,
+#ifdef COUNT_ADVANCES
+    .advanced = 0,
+    .advanced_at_mark = UINT32_MAX,
+#endif
+#if DEBUG
     .marked = -1,
     .marked_by = "",
     .needs_free = false,
+    .column_queries = 0,
 #endif
   };
 }
 
-#ifdef DEBUG
+/**
+ * The column of the lookahead, counted in characters from the last `\n`.
+ */
+static uint32_t current_column(State *state) {
+  if (!state->column_known) {
+#if DEBUG
+    state->column_queries++;
+#endif
+    state->column = state->lexer->get_column(state->lexer);
+    state->column_known = true;
+  }
+  return state->column;
+}
+
+/**
+ * Advance the lexer by one character, keeping the cached column in sync. Advancing at EOF is a no-op in the runtime.
+ */
+static void advance(State *state, bool skip) {
+  if (state->column_known) {
+    if (PEEK == '\n') state->column = 0;
+    else if (PEEK != 0 || !state->lexer->eof(state->lexer)) state->column++;
+  }
+#ifdef COUNT_ADVANCES
+  state->advanced++;
+#endif
+  state->lexer->advance(state->lexer, skip);
+}
+
+#if DEBUG
 static void debug_indents(indent_vec *indents) {
   if (indents->len == 0) LOG(VERBOSE, "empty");
   bool empty = true;
@@ -234,15 +362,15 @@ static void debug_indents(indent_vec *indents) {
 
 static void debug_state(State *state) {
   LOG(VERBOSE, "State { syms = ");
-  debug_valid(state->symbols);
-  LOG(VERBOSE, "col = %d", state->lexer->get_column(state->lexer));
+  debug_valid(state->valid);
+  LOG(VERBOSE, "col = %d", COL);
   LOG(VERBOSE, ", indents = ");
   debug_indents(state->indents);
   LOG(VERBOSE, " }\n");
 }
 #else
-static void debug_indents(indent_vec *indents) { return; }
-static void debug_state(State *state) { return; }
+#define debug_indents(indents) do {} while (0)
+#define debug_state(state) do {} while (0)
 #endif
 
 /**
@@ -255,7 +383,7 @@ static bool is_eof(State *state) { return state->lexer->eof(state->lexer); }
  * The parser's position in the current line.
  */
 static uint32_t column(State *state) {
-  return is_eof(state) ? 0 : state->lexer->get_column(state->lexer);
+  return is_eof(state) ? 0 : COL;
 }
 
 /**
@@ -266,17 +394,24 @@ static uint32_t column(State *state) {
  * before a `where` token.
  */
 
+static void mark_end(State *state) {
+#ifdef COUNT_ADVANCES
+  state->advanced_at_mark = state->advanced;
+#endif
+  state->lexer->mark_end(state->lexer);
+}
+
 // Only use string literals we actually need
-#ifdef DEBUG
+#if DEBUG
 static void MARK(char *marked_by, bool needs_free, State *state) {
   state->marked = column(state);
-  if (state->needs_free) free(state->marked_by);
+  if (state->needs_free) ts_free(state->marked_by);
   state->marked_by = marked_by;
   state->needs_free = needs_free;
-  state->lexer->mark_end(state->lexer);
+  mark_end(state);
 }
 #else
-#define MARK(s, nf, state) state->lexer->mark_end(state->lexer);
+#define MARK(s, nf, state) mark_end(state);
 #endif
 
 // --------------------------------------------------------------------------------------------------------
@@ -288,57 +423,162 @@ static void MARK(char *marked_by, bool needs_free, State *state) {
  */
 
 static bool seq(const char * restrict s, State *state) {
-  size_t len = strlen(s);
-  for (size_t i = 0; i < len; i++) {
-    int32_t c = s[i];
-    int32_t c2 = PEEK;
-    if (c != c2) return false;
+  for (; *s != 0; s++) {
+    if (*s != PEEK) return false;
     S_ADVANCE;
   }
   return true;
 }
 
-#define WS_CASES \
-  case ' ': \
-  case '\f': \
-  case '\n': \
-  case '\r': \
-  case '\t': \
-  case '\v'
+// --------------------------------------------------------------------------------------------------------
+// Character classes
+// --------------------------------------------------------------------------------------------------------
 
 /**
- * Require that the next character is whitespace (space or newline) without advancing the parser.
+ * Nearly every lookahead goes through one of the predicates below, so they share a single precomputed table of class
+ * bits for ASCII instead of each running its own switch.
+ * The only non-ASCII class is the emoji range that `grammar/regex.js` allows in identifiers.
  */
-static bool isws(uint32_t c) {
-  switch (c) {
-    WS_CASES: return true;
-    default: return false;
-  }
+typedef enum {
+  C_WS = 1 << 0, // space, tab, line breaks, form feed, vertical tab
+  C_NEWLINE = 1 << 1, // resets the indent count
+  C_TOKEN_END = 1 << 2, // may terminate a keyword or varsym
+  C_SYMBOLIC = 1 << 3, // may be part of a symbolic operator; `!` and `|` have special meanings on their own
+  C_DIGIT = 1 << 4,
+  C_ALPHA = 1 << 5, // ASCII letters only, unlike libc `isalpha` on code points
+  C_IDENT = 1 << 6, // may be part of a wordy identifier
+} CharClass;
+
+#define EMOJI_FIRST 0x1f400
+#define EMOJI_LAST 0x1faff
+
+#define LETTER (C_ALPHA | C_IDENT)
+#define DIGIT (C_DIGIT | C_IDENT)
+static const uint8_t ascii_classes[128] = {
+  [0] = C_TOKEN_END, ['('] = C_TOKEN_END, [')'] = C_TOKEN_END, ['['] = C_TOKEN_END, [']'] = C_TOKEN_END,
+  ['\t'] = C_WS | C_TOKEN_END, ['\v'] = C_WS | C_TOKEN_END, [' '] = C_WS | C_TOKEN_END,
+  ['\n'] = C_WS | C_NEWLINE | C_TOKEN_END, ['\f'] = C_WS | C_NEWLINE | C_TOKEN_END,
+  ['\r'] = C_WS | C_NEWLINE | C_TOKEN_END,
+  ['!'] = C_SYMBOLIC | C_IDENT,
+  ['$'] = C_SYMBOLIC, ['%'] = C_SYMBOLIC, ['&'] = C_SYMBOLIC, ['*'] = C_SYMBOLIC, ['+'] = C_SYMBOLIC,
+  ['-'] = C_SYMBOLIC, ['.'] = C_SYMBOLIC, ['/'] = C_SYMBOLIC, [':'] = C_SYMBOLIC, ['<'] = C_SYMBOLIC,
+  ['='] = C_SYMBOLIC, ['>'] = C_SYMBOLIC, ['\\'] = C_SYMBOLIC, ['^'] = C_SYMBOLIC, ['|'] = C_SYMBOLIC,
+  ['~'] = C_SYMBOLIC,
+  ['\''] = C_IDENT, ['_'] = C_IDENT,
+  ['0'] = DIGIT, ['1'] = DIGIT, ['2'] = DIGIT, ['3'] = DIGIT, ['4'] = DIGIT, ['5'] = DIGIT, ['6'] = DIGIT,
+  ['7'] = DIGIT, ['8'] = DIGIT, ['9'] = DIGIT,
+  ['A'] = LETTER, ['B'] = LETTER, ['C'] = LETTER, ['D'] = LETTER, ['E'] = LETTER, ['F'] = LETTER, ['G'] = LETTER,
+  ['H'] = LETTER, ['I'] = LETTER, ['J'] = LETTER, ['K'] = LETTER, ['L'] = LETTER, ['M'] = LETTER, ['N'] = LETTER,
+  ['O'] = LETTER, ['P'] = LETTER, ['Q'] = LETTER, ['R'] = LETTER, ['S'] = LETTER, ['T'] = LETTER, ['U'] = LETTER,
+  ['V'] = LETTER, ['W'] = LETTER, ['X'] = LETTER, ['Y'] = LETTER, ['Z'] = LETTER, ['a'] = LETTER, ['b'] = LETTER,
+  ['c'] = LETTER, ['d'] = LETTER, ['e'] = LETTER, ['f'] = LETTER, ['g'] = LETTER, ['h'] = LETTER, ['i'] = LETTER,
+  ['j'] = LETTER, ['k'] = LETTER, ['l'] = LETTER, ['m'] = LETTER, ['n'] = LETTER, ['o'] = LETTER, ['p'] = LETTER,
+  ['q'] = LETTER, ['r'] = LETTER, ['s'] = LETTER, ['t'] = LETTER, ['u'] = LETTER, ['v'] = LETTER, ['w'] = LETTER,
+  ['x'] = LETTER, ['y'] = LETTER, ['z'] = LETTER,
+};
+#undef LETTER
+#undef DIGIT
+
+static uint8_t char_class(int32_t c) {
+  if (c >= 0 && c < 128) return ascii_classes[c];
+  return (c >= EMOJI_FIRST && c <= EMOJI_LAST) ? C_IDENT : 0;
 }
 
+/**
+ * Require that the next character is whitespace (space or newline) without advancing the parser.
+ */
+static bool isws(int32_t c) { return char_class(c) & C_WS; }
+
 /**
  * A token like a varsym can be terminated by whitespace or brackets.
  */
-static bool token_end(uint32_t c) {
-  switch (c) {
-    WS_CASES:
-    case 0:
-    case '(':
-    case ')':
-    case '[':
-    case ']':
-      return true;
-    default:
-      return false;
-  }
-}
+static bool token_end(int32_t c) { return char_class(c) & C_TOKEN_END; }
+
+static bool is_newline(int32_t c) { return char_class(c) & C_NEWLINE; }
+
+#define NEWLINE_CASES \
+  case '\n': \
+  case '\r': \
+  case '\f'
+
+// $%^&*-=+<>.~\\/|:!
+// Note: `!` can initialize a layout as a bang
+static bool symbolic(int32_t c) { return char_class(c) & C_SYMBOLIC; }
+
+static bool is_digit(int32_t c) { return char_class(c) & C_DIGIT; }
+
+static bool is_alnum(int32_t c) { return char_class(c) & (C_ALPHA | C_DIGIT); }
+
+// --------------------------------------------------------------------------------------------------------
+// Keywords
+// --------------------------------------------------------------------------------------------------------
+
+typedef enum {
+  KW_NONE,
+  KW_WHERE,
+  KW_WITH,
+  KW_IN,
+  KW_THEN,
+  KW_ELSE,
+} Keyword;
+
+/**
+ * States of a DFA over the layout-relevant keywords. `KS_DEAD` is 0, so every transition that is not listed below
+ * rejects.
+ */
+typedef enum {
+  KS_DEAD,
+  KS_START,
+  KS_W, KS_WH, KS_WHE, KS_WHER, KS_WHERE,
+  KS_WI, KS_WIT, KS_WITH,
+  KS_I, KS_IN,
+  KS_T, KS_TH, KS_THE, KS_THEN,
+  KS_E, KS_EL, KS_ELS, KS_ELSE,
+  KS_COUNT,
+} KeywordState;
+
+#define KS_EDGE(c, next) [(c) - 'a'] = (next)
+static const uint8_t keyword_dfa[KS_COUNT][26] = {
+  [KS_START] = { KS_EDGE('w', KS_W), KS_EDGE('i', KS_I), KS_EDGE('t', KS_T), KS_EDGE('e', KS_E) },
+  [KS_W] = { KS_EDGE('h', KS_WH), KS_EDGE('i', KS_WI) },
+  [KS_WH] = { KS_EDGE('e', KS_WHE) },
+  [KS_WHE] = { KS_EDGE('r', KS_WHER) },
+  [KS_WHER] = { KS_EDGE('e', KS_WHERE) },
+  [KS_WI] = { KS_EDGE('t', KS_WIT) },
+  [KS_WIT] = { KS_EDGE('h', KS_WITH) },
+  [KS_I] = { KS_EDGE('n', KS_IN) },
+  [KS_T] = { KS_EDGE('h', KS_TH) },
+  [KS_TH] = { KS_EDGE('e', KS_THE) },
+  [KS_THE] = { KS_EDGE('n', KS_THEN) },
+  [KS_E] = { KS_EDGE('l', KS_EL) },
+  [KS_EL] = { KS_EDGE('s', KS_ELS) },
+  [KS_ELS] = { KS_EDGE('e', KS_ELSE) },
+};
+#undef KS_EDGE
+
+static const Keyword keyword_accepts[KS_COUNT] = {
+  [KS_WHERE] = KW_WHERE,
+  [KS_WITH] = KW_WITH,
+  [KS_IN] = KW_IN,
+  [KS_THEN] = KW_THEN,
+  [KS_ELSE] = KW_ELSE,
+};
 
 /**
- * Require that the argument string follows the current position and is followed by whitespace.
- * See `seq`
+ * Recognize one of the keywords in `Keyword`, followed by a `token_end` character, in a single forward pass.
+ * Consumes the keyword on success and stops at the first character that rules all keywords out otherwise, leaving the
+ * number of consumed characters in `length`.
  */
-static bool token(const char *restrict s, State *state) {
-  return seq(s, state) && token_end(PEEK);
+static Keyword keyword(uint32_t *length, State *state) {
+  uint8_t ks = KS_START;
+  *length = 0;
+  while (PEEK >= 'a' && PEEK <= 'z') {
+    ks = keyword_dfa[ks][PEEK - 'a'];
+    if (ks == KS_DEAD) return KW_NONE;
+    S_ADVANCE;
+    (*length)++;
+  }
+  return token_end(PEEK) ? keyword_accepts[ks] : KW_NONE;
 }
 
 /**
@@ -382,19 +622,6 @@ static bool smaller_indent(uint32_t indent, State *state) {
 static bool indent_lesseq(uint32_t indent, State *state) { return indent_exists(state) && indent <= VEC_BACK(state->indents); }
 
 
-#define NEWLINE_CASES \
-  case '\n': \
-  case '\r': \
-  case '\f'
-
-static bool is_newline(uint32_t c) {
-  switch (c) {
-    NEWLINE_CASES:
-      return true;
-    default:
-      return false;
-  }
-}
 
 /**
  * NOT NECESSARY IN UNISON. JUST HASKELL.
@@ -407,44 +634,7 @@ static bool is_newline(uint32_t c) {
 /**
  * Require that the parser determined an error in the previous step (see `all_syms`).
  */
-static bool after_error(State *state) { return all_syms(state->symbols); }
-
-// $%^&*-=+<>.~\\/|:
-// Note: `!` can initialize a layout as a bang
-#define ILLEGAL_LINE_INITIAL_SYMBOLICS \
-    case '$': \
-    case '%': \
-    case '^': \
-    case '&': \
-    case '*': \
-    case '-': \
-    case '=': \
-    case '+': \
-    case '<': \
-    case '>': \
-    case '.': \
-    case '~': \
-    case '\\': \
-    case '/': \
-    case ':'
-
-#define SYMBOLICS_WITHOUT_BAR \
-    ILLEGAL_LINE_INITIAL_SYMBOLICS: \
-    case '!' \
-
-#define SYMBOLIC_CASES \
-    SYMBOLICS_WITHOUT_BAR: \
-    case '|'
-
-static bool symbolic(uint32_t c) {
-  switch (c) {
-    SYMBOLIC_CASES:
-      return true;
-    default:
-      return false;
-  }
-}
-
+static bool after_error(State *state) { return all_syms(state->valid); }
 
 typedef enum {
   S_CON,
@@ -469,9 +659,12 @@ typedef enum {
 typedef struct {
     Sym sym;
     bool finished;
+#ifdef UNISON_SCANNER_DECISIONS
+    const char *by; // the `desc` of the `finish` that produced the symbol
+#endif
 } Result;
 
-#ifdef DEBUG
+#if DEBUG
 static void debug_result(Result res) {
   LOG(VERBOSE, "Result { finished = %d", res.finished);
   if (res.finished) {
@@ -498,7 +691,13 @@ static Result res_fail = {.sym = FAIL, .finished = true};
  */
 static Result finish(const Sym s, char *restrict desc) {
   LOG(INFO, "finish: %s\n", desc);
-  return res_finish(s);
+  Result res = res_finish(s);
+#ifdef UNISON_SCANNER_DECISIONS
+  res.by = desc;
+#else
+  (void) desc; // only logged, in trace builds
+#endif
+  return res;
 }
 
 /**
@@ -512,7 +711,7 @@ static Result finish_if_valid(const Sym s, char *restrict desc, State *state) {
 /**
  * Add one level of indentation to the stack, caused by starting a layout.
  */
-static void push(uint16_t ind, State *state) {
+static void push(uint32_t ind, State *state) {
   LOG(VERBOSE, "push: %d\n", ind);
   VEC_PUSH(state->indents, ind);
 }
@@ -614,7 +813,8 @@ static uint32_t count_indent(State *state) {
  */
 static Result eof(State *state) {
   LOG(INFO, "->eof (%u, %c)\n", COL, PEEK);
-  if (is_eof(state)) {
+  // The lookahead is 0 at the end of the input, so any other character settles it without asking the lexer.
+  if (PEEK == 0 && is_eof(state)) {
     if (SYM(EMPTY)) {
       return finish(EMPTY, "eof");
     }
@@ -666,7 +866,7 @@ static Result hash(State *state) {
     if (!is_eof(state) && PEEK == '#') { // Could be the cid of a hash
       S_ADVANCE;
       bool found = false;
-      while (isdigit(PEEK) || isalpha(PEEK)) {
+      while (is_alnum(PEEK)) {
         found = true;
         S_ADVANCE;
       }
@@ -682,7 +882,7 @@ static Result hash(State *state) {
     if (!is_eof(state) && PEEK == '.') { // Could be cyclic of a hash
       S_ADVANCE;
       bool found = false;
-      while (isdigit(PEEK) || isalpha(PEEK)) {
+      while (is_alnum(PEEK)) {
         found = true;
         S_ADVANCE;
       }
@@ -697,6 +897,33 @@ static Result hash(State *state) {
   return res_cont;
 }
 
+/**
+ * Everything after a `---` line is folded away, and it is often far longer than the code above it. Instead of one token
+ * reaching to the end of the file, a fold is scanned as a `FOLD` chunk followed by `FOLD_CONTINUATION` chunks.
+ *
+ * A chunk ends after a line whose hash has its low bits clear, or after `FOLD_CHUNK_MAX` characters. Since the
+ * boundaries depend on the lines around them rather than on where the fold starts, an edit only moves the boundaries of
+ * the chunk it touches, and incremental parsing reuses all the others.
+ */
+#define FOLD_CHUNK_MAX 16384
+#define FOLD_BOUNDARY_MASK 15
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+static void fold_chunk(State *state) {
+  uint32_t hash = FNV_OFFSET;
+  for (uint32_t length = 0; length < FOLD_CHUNK_MAX && !(PEEK == 0 && is_eof(state)); length++) {
+    int32_t c = PEEK;
+    S_ADVANCE;
+    if (c == '\n') {
+      if ((hash & FOLD_BOUNDARY_MASK) == 0) return;
+      hash = FNV_OFFSET;
+    } else {
+      hash = (hash ^ (uint32_t) c) * FNV_PRIME;
+    }
+  }
+}
+
 /**
  * Check for fold. However, because check for fold consumes -- it needs to consider line comments as well.
  */
@@ -707,8 +934,7 @@ static Result fold(State *state) {
     switch(PEEK) {
       case '-': { // FOLD
         // TODO ADVANCE and PEEK, it's only FOLD if newline!!
-        while(!is_eof(state)) S_ADVANCE;
-        LOG(VERBOSE, "after advancing, PEEK is %c and should be EOF: %s\n", PEEK, is_eof(state) ? "true" : "false");
+        fold_chunk(state);
         MARK("fold", false, state);
         return finish(FOLD, "fold");
       }
@@ -762,51 +988,192 @@ static Result newline_semicolon(uint32_t indent, State *state) {
 }
 
 /**
- * Parse an inline `where` or `with` token.
+ * A path is the namespace prefix of a qualified name, like `base.data.List.` in `base.data.List.map`: an optional
+ * leading `.` and one or more segments that are each followed by a `.`. The segments are
+ *   - wordy: a letter, `_` or emoji, then at least one more of them or `!` or `'`, and no digits
+ *   - symbolic: a run of symbolic characters other than `.` that `symbolic_segment` accepts
+ * The path ends after the last `.` that follows a valid segment, and the name it qualifies is lexed by the grammar.
  *
- * Necessary because `is_newline_where` needs to know that no `where` may follow, and `with` can end a layout started by `handle`.
+ * This used to be a regex of seven alternatives in `grammar/regex.js`, which made the generated lexer carry it along in
+ * every state that can start an identifier or operator. Here it is a loop over the character class table, run where
+ * the scanner already looks at a word or symbolic run.
  */
-static Result where_or_with(State *state) {
-  LOG(INFO, "->where_or_with (col = %u, peek = %c)\n", COL, PEEK);
-  if (PEEK == 'w') {
-    S_ADVANCE;
-    if (token("here", state)) {
-      if (SYM(WHERE)) {
-            MARK("where_or_when", false, state);
-            return finish(WHERE, "where");
-          }
-    } else if (SYM(END) && token("ith", state)) {
-      return layout_end("with", state);
+static bool path_wordy_start(int32_t c) {
+  uint8_t cls = char_class(c);
+  return (cls & C_IDENT) && !(cls & C_DIGIT) && c != '!' && c != '\'';
+}
+
+static bool path_wordy(int32_t c) { return (char_class(c) & (C_IDENT | C_DIGIT)) == C_IDENT; }
+
+static bool path_symbolic(int32_t c) { return c != '.' && symbolic(c); }
+
+/**
+ * The symbolic characters of the current segment, as far as they matter for `symbolic_segment`.
+ */
+typedef struct {
+  uint32_t length;
+  int32_t first;
+  int32_t second;
+} Segment;
+
+static void segment_add(Segment *segment, int32_t c) {
+  if (segment->length == 0) segment->first = c;
+  else if (segment->length == 1) segment->second = c;
+  segment->length++;
+}
+
+/**
+ * Whether a run of symbolic characters is a valid path segment: `=`, `|` and `!` are not one on their own, a pair
+ * must not be `->`, `&&` or `||` or end in `&`, `-` or `|` after any other character, and longer runs all are.
+ */
+static bool symbolic_segment(Segment segment) {
+  switch (segment.length) {
+    case 0:
+      return false;
+    case 1:
+      return segment.first != '=' && segment.first != '|' && segment.first != '!';
+    case 2:
+      switch (segment.first) {
+        case '-': return segment.second != '>';
+        case '&': return segment.second != '&';
+        case '|': return segment.second != '|';
+        default: return segment.second != '&' && segment.second != '-' && segment.second != '|';
+      }
+    default:
+      return true;
+  }
+}
+
+/**
+ * Consume the segments of a path from the start of one, marking the end after each `.` that closes a valid segment.
+ * Returns the number of them.
+ */
+static uint32_t path_segments(State *state) {
+  for (uint32_t segments = 0;; segments++) {
+    bool valid;
+    if (path_wordy_start(PEEK)) {
+      uint32_t length = 0;
+      for (; path_wordy(PEEK); length++) S_ADVANCE;
+      valid = length >= 2;
+    } else if (path_symbolic(PEEK)) {
+      Segment segment = {0};
+      for (; path_symbolic(PEEK); S_ADVANCE) segment_add(&segment, PEEK);
+      valid = symbolic_segment(segment);
+    } else {
+      return segments;
     }
+    if (!valid || PEEK != '.') return segments;
+    S_ADVANCE;
+    MARK("path", false, state);
   }
-  return res_cont;
 }
 
 /**
- * An `in` token ends the layout openend by a `let` and its nested layouts.
+ * Consume a run of decimal digits, and report whether there was at least one.
+ */
+static bool digits(State *state) {
+  bool any = false;
+  for (; is_digit(PEEK); any = true) S_ADVANCE;
+  return any;
+}
+
+/**
+ * Consume the exponent of a float like `e-3`, if there is one with at least one digit, and mark its end.
+ */
+static bool exponent(State *state) {
+  if (PEEK != 'e' && PEEK != 'E') return false;
+  S_ADVANCE;
+  if (PEEK == '+' || PEEK == '-') S_ADVANCE;
+  if (!digits(state)) return false;
+  MARK("number", false, state);
+  return true;
+}
+
+/**
+ * A float without digits before its dot, like `.5` or `-.5e3`, after the dot. The next character must be a digit.
+ */
+static Result fraction(State *state) {
+  digits(state);
+  MARK("number", false, state);
+  exponent(state);
+  return finish(FLOAT, "float");
+}
+
+/**
+ * A path that starts at the next character, or a float like `.5` if it is a `.` followed by a digit.
  */
-static Result in(State *state) {
-  if (SYM(IN) && token("in", state)) {
-    MARK("in", false, state);
-    pop(state);
-    return finish(IN, "in");
+static Result path(State *state) {
+  LOG(INFO, "->path (%c)\n", PEEK);
+  if (PEEK == '.') {
+    S_ADVANCE;
+    if (is_digit(PEEK)) return SYM(FLOAT) ? fraction(state) : res_fail;
   }
-  return res_cont;
+  return SYM(PATH) && path_segments(state) > 0 ? finish(PATH, "path") : res_fail;
+}
+
+/**
+ * A path whose first segment is a word of which `length` characters were consumed already.
+ */
+static Result path_after_word(uint32_t length, State *state) {
+  for (; path_wordy(PEEK); length++) S_ADVANCE;
+  if (length < 2 || PEEK != '.') return res_fail;
+  S_ADVANCE;
+  MARK("path", false, state);
+  path_segments(state);
+  return finish(PATH, "path");
 }
 
 /**
- * An `else` token may end a layout opened in the body of a `then`.
+ * A path whose first segment is symbolic and starts with the characters in `segment`, which were consumed already.
  */
-static Result else_(State *state) {
-  return token("else", state) ? layout_end("else", state) : res_cont;
+static Result path_after_symbols(Segment segment, State *state) {
+  if (!SYM(PATH)) return res_fail;
+  for (; path_symbolic(PEEK); S_ADVANCE) segment_add(&segment, PEEK);
+  if (!symbolic_segment(segment) || PEEK != '.') return res_fail;
+  S_ADVANCE;
+  MARK("path", false, state);
+  path_segments(state);
+  return finish(PATH, "path");
 }
 
 /**
- * A `then` token may end a layout opened in the body of an `if`.
+ * Parse a keyword that matters for layouts:
+ *   - `where` is parsed here because `is_newline_where` needs to know that no `where` may follow
+ *   - `with` can end a layout started by `handle`
+ *   - `in` ends the layout opened by a `let` and its nested layouts
+ *   - `then` may end a layout opened in the body of an `if`
+ *   - `else` may end a layout opened in the body of a `then`
  */
- static Result then(State *state) {
-   return token("then", state) ? layout_end("then", state) : res_cont;
- }
+static Result keyword_token(State *state) {
+  LOG(INFO, "->keyword_token (col = %u, peek = %c)\n", COL, PEEK);
+  uint32_t length;
+  switch (keyword(&length, state)) {
+    case KW_WHERE:
+      if (SYM(WHERE)) {
+        MARK("where", false, state);
+        return finish(WHERE, "where");
+      }
+      break;
+    case KW_WITH:
+      return layout_end("with", state);
+    case KW_IN:
+      if (SYM(IN)) {
+        MARK("in", false, state);
+        pop(state);
+        return finish(IN, "in");
+      }
+      break;
+    case KW_THEN:
+      return layout_end("then", state);
+    case KW_ELSE:
+      return layout_end("else", state);
+    case KW_NONE:
+      // The word may be the first segment of a path instead.
+      if (SYM(PATH)) return path_after_word(length, state);
+      break;
+  }
+  return res_cont;
+}
 
 /**
  * Consume all characters up to the end of line and succeed with `syms::commment`.
@@ -831,20 +1198,75 @@ inline_comment_after_skip:
 }
 
 /**
- * Parse for byte literal. If detect "0x" then fail and let the JS grammar handle this.
+ * The value of a hexadecimal digit, or -1 for any other character.
  */
-static Result byte_literal(State *state) {
-  LOG(INFO, "->byte_literal (col = %u, peek = %c)\n", COL, PEEK);
-  if (!is_eof(state) && PEEK == '0') {
+static int32_t hex_digit(int32_t c) {
+  if (is_digit(c)) return c - ASCII_OFFSET;
+  int32_t lower = c | 0x20;
+  return lower >= 'a' && lower <= 'f' ? lower - 'a' + 10 : -1;
+}
+
+/**
+ * Parse a numeric literal whose first digit is the next character. `sign` is the `+` or `-` that was consumed before
+ * it, or 0 if there is none.
+ *
+ *   - `0x` followed by hex digits is a `Nat` in hex notation, `0xs` followed by hex digits is `Bytes`
+ *   - digits with a fraction like `.5`, an exponent like `e-3`, or both are a `Float`
+ *   - any other run of digits is a `Nat`, or an `Int` if it has a sign
+ *
+ * Whole numbers are accumulated with checked arithmetic while they are scanned, so a `Nat` or hex literal outside of
+ * [0, 18446744073709551615] and an `Int` outside of [-9223372036854775808, 9223372036854775807] fail rather than being
+ * truncated, which leaves them to error recovery. A `.` or exponent that isn't followed by a digit is not part of the
+ * literal: `1.foo` is `1` and `.foo`.
+ */
+static Result number(int32_t sign, State *state) {
+  LOG(INFO, "->number (sign = %c, peek = %c)\n", sign ? sign : ' ', PEEK);
+  uint64_t value = 0;
+  bool overflow = false;
+  if (sign == 0 && PEEK == '0') {
     S_ADVANCE;
-    if (!is_eof(state) && PEEK == 'x') {
-      return res_fail;
+    MARK("number", false, state);
+    if (PEEK == 'x') {
+      S_ADVANCE;
+      Sym sym = HEX;
+      if (PEEK == 's') {
+        S_ADVANCE;
+        sym = BYTES;
+      }
+      // `0x` without a digit is `0` followed by an identifier.
+      if (hex_digit(PEEK) < 0) return finish_if_valid(NAT, "nat", state);
+      for (int32_t d; (d = hex_digit(PEEK)) >= 0; S_ADVANCE) {
+        if (sym == HEX) overflow |= ckd_mul(&value, value, 16) | ckd_add(&value, value, d);
+      }
+      MARK("number", false, state);
+      return overflow ? res_fail : finish_if_valid(sym, sym == HEX ? "hex" : "bytes", state);
     }
   }
-  return res_cont;
+  for (; is_digit(PEEK); S_ADVANCE) {
+    overflow |= ckd_mul(&value, value, 10) | ckd_add(&value, value, PEEK - ASCII_OFFSET);
+  }
+  MARK("number", false, state);
+  if (SYM(FLOAT)) {
+    bool fraction = false;
+    bool dead_end = false;
+    if (PEEK == '.') {
+      S_ADVANCE;
+      fraction = digits(state);
+      dead_end = !fraction;
+      if (fraction) MARK("number", false, state);
+    }
+    if (!dead_end && exponent(state)) return finish(FLOAT, "float");
+    if (fraction) return finish(FLOAT, "float");
+  }
+  if (sign != 0) {
+    uint64_t limit = sign == '-' ? (uint64_t) INT64_MAX + 1 : INT64_MAX;
+    if (SYM(INT)) return overflow || value > limit ? res_fail : finish(INT, "int");
+    return finish_if_valid(FLOAT, "float", state);
+  }
+  if (SYM(NAT)) return overflow ? res_fail : finish(NAT, "nat");
+  return finish_if_valid(FLOAT, "float", state);
 }
 
-
 /**
  * Handle an operator that begins with `=`. If it's a single `=` then fail
  * and allow the JS to handle it instead. Without this, the JS often
@@ -941,8 +1363,92 @@ static Result paren_symop(State *state) {
 //   return res_cont;
 // }
 
-static bool found_pipe_or_logical_op(uint8_t pipe_count, uint8_t amp_count) {
-  return pipe_count == 1 || pipe_count == 2 || amp_count == 2;
+/**
+ * Consume a run of symbolic characters and decide whether it is a `SYMOP`. The run is left to the grammar if
+ *   - it consists of `|` and `&` only and contains a `|` or two `&`, like `|`, `||` and `&&`,
+ *   - it starts with `-` and contains a `>`, like `->`,
+ *   - it ends in `:` anywhere but at the end of the file, like the `:` of a type signature,
+ *   - it is followed by anything but whitespace, `#` or the end of the file.
+ * Every character is looked at once, and the end of the token is marked once.
+ *
+ * A single `+` or `-` that is followed by a digit is the sign of a number if an `Int` or `Float` can occur here, and a
+ * `.` followed by a digit at the start of the run or after such a sign begins a `Float` like `.5` or `-.5`.
+ *
+ * If a `PATH` can occur here, the run is also split into path segments at its dots, with `segment` holding the
+ * characters that `operator` consumed before the run and `segments` the number of segments consumed before those.
+ * When the run is not a `SYMOP`, the path it starts is.
+ */
+static Result symbolic_run(Segment segment, uint32_t segments, State *state) {
+  bool arrow = PEEK == '-';
+  bool logical = true; // only `|` and `&` so far
+  bool path = SYM(PATH);
+  bool leading_dot = segment.length == 0 && segments == 0;
+  bool number_start = leading_dot; // nothing but a sign so far
+  if ((PEEK == '+' || PEEK == '-') && (SYM(INT) || SYM(FLOAT))) {
+    int32_t sign = PEEK;
+    S_ADVANCE;
+    if (is_digit(PEEK)) return number(sign, state);
+    logical = false;
+    segment_add(&segment, sign);
+    leading_dot = false;
+  }
+  bool symop = true;
+  bool bar = false;
+  bool amp = false;
+  bool double_amp = false;
+  bool colon = false;
+  while (symbolic(PEEK)) {
+    LOG(VERBOSE, "[operator] Looping with PEEK = %c\n", PEEK);
+    int32_t c = PEEK;
+    switch (c) {
+      case '|':
+        bar = true;
+        break;
+      case '&':
+        double_amp = amp;
+        amp = true;
+        break;
+      case '>':
+        if (arrow) {
+          if (!path && segments == 0) return res_fail;
+          symop = false;
+        }
+        logical = false;
+        break;
+      default:
+        logical = false;
+        break;
+    }
+    colon = c == ':';
+    S_ADVANCE;
+    if (c == '.' && number_start && is_digit(PEEK) && SYM(FLOAT)) return fraction(state);
+    number_start = false;
+    if (path) {
+      if (c != '.') {
+        segment_add(&segment, c);
+      } else if (symbolic_segment(segment)) {
+        MARK("path", false, state);
+        segments++;
+        segment.length = 0;
+      } else {
+        path = segment.length == 0 && leading_dot;
+      }
+      leading_dot = false;
+    }
+  }
+  bool at_eof = PEEK == 0 && is_eof(state);
+  LOG(VERBOSE, "[operator] encountered a non-symbol (PEEK = %c, eof = %d)\n", PEEK, at_eof);
+  if (colon && !at_eof) symop = false; // a `:` by itself is part of a type signature, not an operator
+  if (logical && (bar || double_amp)) symop = false;
+  if (!at_eof && !isws(PEEK) && PEEK != '#') symop = false;
+  if ((path || segments > 0) && !(symop && SYM(SYMOP))) {
+    // After a `.`, the path may go on with a wordy segment.
+    if (path && segment.length == 0 && path_wordy_start(PEEK)) segments += path_segments(state);
+    if (segments > 0) return finish(PATH, "path");
+  }
+  if (!symop) return res_fail;
+  MARK("operator", false, state);
+  return finish_if_valid(SYMOP, "symbolic operator", state);
 }
 
 /**
@@ -955,106 +1461,56 @@ static bool found_pipe_or_logical_op(uint8_t pipe_count, uint8_t amp_count) {
  * Needs to recognize `(OPERATOR)` as a parenthesized operator
  */
 static Result operator(State *state) {
-    // return res_cont;
   LOG(INFO, "->operator (%u, %c)\n", COL, PEEK);
 
-  if (is_eof(state)) return res_cont;
+  if (PEEK == 0 && is_eof(state)) return res_cont;
+
+  // The characters consumed before `symbolic_run`, for a path that starts here.
+  Segment segment = {0};
 
   // Process WATCH
-  if (COL == 0 && PEEK == '>') {
+  if (PEEK == '>' && COL == 0) {
     S_ADVANCE;
+    segment_add(&segment, '>');
     if (!symbolic(PEEK) ) {
       MARK("operator", false, state);
       return finish_if_valid(WATCH, "watch", state);
     }
-    // return res_fail;
   }
-  // return res_cont;
 
   if (PEEK == '(') {
     Result res = paren_symop(state);
     SHORT_SCANNER;
   }
 
-  bool parenthesized = false;
-
   if (!symbolic(PEEK)) return res_fail;
   if (PEEK == '=') {
     Result res = equals(state);
     SHORT_SCANNER;
+    segment_add(&segment, '=');
   }
 
   // Detect bangs and let JS handle them
   if ( PEEK == '!') {
     S_ADVANCE;
+    segment_add(&segment, '!');
     if (is_eof(state) || PEEK == '(' || !symbolic(PEEK)) {
       return res_fail;
     }
   }
 
-  uint8_t and_count = 0;
-  uint8_t or_count = 0;
-  bool previous_was_colon = false;
-  bool is_on_first_char = true; // Used so alongside arrow_has_begun we can be sure to match -> and never --> or =-> or ~~-> etc.
-  bool arrow_has_begun = false; // Used to track if we have - so if we encounter > trigger FAIL for JS lexer to take over
-  /*
-   * scan until we encounter a non-symbol char; at that point, if
-   * - whitespace or #, succeed SYMOP
-   * - non-whitespace, fail since SYMOP must be surrounded by whitespace
-   *
-   */
-  while (!is_eof(state)) {
-    LOG(VERBOSE, "[operator] Looping with PEEK = %c\n", PEEK);
-    if(arrow_has_begun && PEEK == '>') { // If we were parsing -> as an operator, fail becasue it's not'
-        return res_fail;
-    }
-    if(PEEK == '-' && is_on_first_char) {
-        arrow_has_begun = true;
-    }
-    if (!symbolic(PEEK) && previous_was_colon) {
-      return res_fail; // This means we just recognized a `:` by itself, which is not an operator but part of a type signature.
-    }
-    if (symbolic(PEEK)) { // If we find | or & as first symbol, count it. Otherwise, ensure code never thinks it has found || or &&
-      previous_was_colon = false;
-      switch (PEEK) {
-        case '|': {
-          if (or_count == 0 || or_count == 1) ++or_count;
-          break;
-        }
-        case '&': {
-          if (and_count == 0 || and_count == 1) ++and_count;
-          break;
-        }
-        case ':': previous_was_colon = true;
-        default: {
-          or_count = -1;
-          and_count = -1;
-        }
-      }
-      S_ADVANCE;
-      MARK("operator", false, state);
-    } else {
-      LOG(VERBOSE, "[operator] encountered a non-symbol (PEEK = %c, or_count = %u, and_count = %u)\n", PEEK, or_count, and_count);
-      if (found_pipe_or_logical_op(or_count, and_count)) return res_fail;
-      return (isws(PEEK) || PEEK == '#') ? finish_if_valid(SYMOP, "symbolic operator", state) : res_fail;
-    }
-    is_on_first_char = false;
-  }
-  if (found_pipe_or_logical_op(or_count, and_count)) return res_fail;
-  S_ADVANCE;
-  MARK("operator", false, state);
-  return finish_if_valid(SYMOP, "symbolic operator", state);
+  return symbolic_run(segment, 0, state);
 }
 
 /**
- * This function is called after a +/- is consumed.
+ * This function is called after a +/- is consumed, which is passed as `sign`.
  * The following cases must be handled:
+ // * 1. a signed number
  // * 2. SYMOP that begins with +/- and is terminated by whitespace or ')', the latter of which indicates a parenthetical operator
  // * 3. post-sign symbolic chars as SYMOP
  // * 4.
  */
-static Result post_pos_neg_sign(State *state, bool can_be_operator) {
-  (void) can_be_operator; // suppresses "unused variable" warning
+static Result post_pos_neg_sign(int32_t sign, State *state) {
   LOG(INFO, "->post_pos_neg_sign; PEEK = %c\n", PEEK);
   Result res = res_fail;
   // Immediately terminate as symop if sign followed by whitespace, EOF, or ')', the latter of which is expected in the case of the parenthetical op pattern in JS grammar.
@@ -1067,23 +1523,35 @@ static Result post_pos_neg_sign(State *state, bool can_be_operator) {
       S_ADVANCE;
       if(!symbolic(PEEK)) {
         return res_fail;
+      } else if (SYM(PATH) && PEEK != '(') {
+        return symbolic_run((Segment) {.length = 2, .first = sign, .second = '>'}, 0, state);
       } else {
         return operator(state);
       }
       break;
     case '.':
       S_ADVANCE;
-      if(isdigit(PEEK)) {
+      if(is_digit(PEEK) && SYM(FLOAT)) {
+        return fraction(state);
+      } else if (SYM(PATH) && PEEK != '(') {
+        // The sign is the first segment of a path like `+.foo`.
+        MARK("path", false, state);
+        if (!symbolic(PEEK)) {
+          path_segments(state);
+          return finish(PATH, "path");
+        }
+        return symbolic_run((Segment) {0}, 1, state);
+      } else if (is_digit(PEEK)) {
         return res_fail;
       } else {
         return operator(state);
       }
       break;
     NUMERIC_CASES:
-      return res_fail;
-      break;
+      return number(sign, state);
     default:
       LOG(VERBOSE, "non-dot symbolic PEEK %c\n", PEEK);
+      if (SYM(PATH) && PEEK != '(') return symbolic_run((Segment) {.length = 1, .first = sign}, 0, state);
       res = operator(state);
       LOG(VERBOSE, "Result of operator: %s\n", sym_names[res.sym]);
       SHORT_SCANNER;
@@ -1103,169 +1571,114 @@ static Result post_pos_neg_sign(State *state, bool can_be_operator) {
  */
 static Result minus(State *state) {
   LOG(INFO, "->minus\n");
-  uint16_t initialColumn = COL;
   if (PEEK != '-') return res_cont;
   S_ADVANCE;
   switch(PEEK) {
     NUMERIC_CASES:
-      return res_fail;
+      return number('-', state);
     case '.': {
-      return post_pos_neg_sign(state, false);
+      return post_pos_neg_sign('-', state);
     }
     case '-': { // COMMENT, FOLD
       S_ADVANCE;
       if (PEEK == '-') { // FOLD
-        while(!is_eof(state)) S_ADVANCE;
+        fold_chunk(state);
         MARK("minus", false, state);
         return finish_if_valid(FOLD, "fold", state);
       }
       return inline_comment(state);
     }
   }
-  return res_cont;
+  // The minus may start a symbolic path segment like `-+`.
+  return SYM(PATH) ? path_after_symbols((Segment) {.length = 1, .first = '-'}, state) : res_cont;
 }
 
 /**
- * Succeed for a comment.
+ * Can appear anywhere. Only call once we've consumed a `{{` (in `brace`).
+ *
+ * This is only the opening `{{`. The rest of the doc block is scanned in `scan_doc`.
  */
-static Result multiline_comment_success(State *state) {
-  MARK("multiline_comment", false, state);
-  return finish(COMMENT, "multiline_comment");
+static Result doc_open(State *state) {
+  LOG(INFO, "[doc_open] (col = %u, peek = %c)\n", COL, PEEK);
+  if (!SYM(DOC_OPEN)) return res_fail;
+  MARK("doc_open", false, state);
+  return finish(DOC_OPEN, "doc open");
 }
 
 /**
- * Can appear anywhere. Only call once we've consumed a `{{` (in `multiline_comment`).
+ * Multiline comments longer than `COMMENT_CHUNK_MIN` characters are split into several `COMMENT` tokens, at the end of a
+ * line whose hash has its low bits clear (see `fold_chunk`), or after `COMMENT_CHUNK_MAX` characters. A single call
+ * never scans more than one chunk, and an edit in a long comment only re-lexes the chunks around it.
+ *
+ * The nesting level at the end of a chunk is kept in the scanner state (see `comment_depth`), and the next call
+ * continues the comment from there in `scan_comment`.
  */
-static Result doc_block(State *state) {
-    LOG(INFO, "[doc_block] (col = %u, peek = %c)\n", COL, PEEK);
-    if (!SYM(DOC_BLOCK)) {
-        return res_fail;
-    }
-    uint16_t level = 1;
-    while (!is_eof(state) && level > 0) {
-        switch(PEEK) {
-            case '{': {
-                S_ADVANCE;
-                if (!is_eof(state) && PEEK == '{') {
-                    ++level;
-                }
-                S_ADVANCE;
-                break;
-            }
-            case '}': {
-                S_ADVANCE;
-                if (!is_eof(state) && PEEK == '}') {
-                    --level;
-                }
-                S_ADVANCE;
-                break;
-            }
-            default: S_ADVANCE;
-        }
-    }
-    if (level == 0) {
-        MARK("doc_block", false, state);
-        return res_finish(DOC_BLOCK);
-    }
-    return res_fail;
-}
-// static Result doc_block(State *state) {
-//   LOG(INFO, "doc_block (col = %u, peek = %c)\n", COL, PEEK);
-//   if (!SYM(DOC_BLOCK)) {
-//     return res_fail;
-//   }
-//   uint16_t level = 0;
-//   for (;;) {
-//     LOG(VERBOSE, "[doc_block] loop (peek = %c");
-//     switch(PEEK) {
-//       case '{': {
-//         S_ADVANCE;
-//         if (PEEK == '{') {
-//           S_ADVANCE;
-//           ++level;
-//         }
-//         break;
-//       }
-//       case '}': {
-//         S_ADVANCE;
-//         if (PEEK == '}') {
-//           S_ADVANCE;
-//           if (level == 0) {
-//             MARK("doc_block", false, state);
-//             return res_finish(DOC_BLOCK);
-//           }
-//           --level;
-//         }
-//         break;
-//       }
-//       case 0: {
-//         Result res = eof(state);
-//         SHORT_SCANNER;
-//         return res_fail;
-//       }
-//       default:
-//         S_ADVANCE;
-//         break;
-//     }
-//   }
-//   while (level > 0 && !is_eof(state)) {
-//     if (PEEK == '{') {
-//       S_ADVANCE;
-//       if (!is_eof(state) && PEEK == '{') {
-//         ++level;
-//       }
-//     }
-//     if (PEEK == '}') {
-//       S_ADVANCE;
-//       if (!is_eof(state) && PEEK == '}') {
-//         --level;
-//       }
-//     }
-//     S_ADVANCE;
-//   }
-//   if (level == 0) {
-//     MARK("doc_block", false, state);
-//     return res_finish(DOC_BLOCK);
-//   }
-//   return res_fail;
-// }
+#define COMMENT_CHUNK_MIN 4096
+#define COMMENT_CHUNK_MAX 16384
+#define COMMENT_BOUNDARY_MASK 15
 
 /**
- * See `nested_comment`.
+ * Scan a multiline comment from inside `depth` nested `{-`, not counting the outermost one.
  *
- * Since {- -} comments and {{ }} doc blocks can be nested arbitrarily, this has to keep track of how many have been openend, so that the
- * outermost comment isn't closed prematurely.
+ * A `{-` that is never closed makes the rest of the file a comment.
  */
-static Result multiline_comment(State *state) {
-  LOG(INFO, "->multiline_comment (col = %u, PEEK = %c)\n", COL, PEEK);
-  uint16_t level = 0;
-  for (;;) {
+static Result comment_chunk(uint32_t depth, State *state) {
+  LOG(INFO, "->comment_chunk (depth = %u, PEEK = %c)\n", depth, PEEK);
+  uint32_t hash = FNV_OFFSET;
+  for (uint32_t length = 0; length < COMMENT_CHUNK_MAX; length++) {
     switch (PEEK) {
       case '{':
         S_ADVANCE;
         if (PEEK == '-') {
           S_ADVANCE;
-          level++;
+          length++;
+          depth++;
         }
         break;
       case '-':
         S_ADVANCE;
         if (PEEK == '}') {
           S_ADVANCE;
-          if (level == 0) return multiline_comment_success(state);
-          level--;
+          length++;
+          if (depth == 0) {
+            state->indents->comment_depth = 0;
+            MARK("multiline_comment", false, state);
+            return finish(COMMENT, "multiline_comment");
+          }
+          depth--;
         }
         break;
-      case 0: {
-        Result res = eof(state);
-        SHORT_SCANNER;
-        return res_fail;
-      }
+      case '\n':
+        S_ADVANCE;
+        if (length >= COMMENT_CHUNK_MIN && (hash & COMMENT_BOUNDARY_MASK) == 0) goto chunk;
+        hash = FNV_OFFSET;
+        break;
+      case 0:
+        if (is_eof(state)) {
+          state->indents->comment_depth = 0;
+          MARK("multiline_comment", false, state);
+          return finish(COMMENT, "unterminated multiline_comment");
+        }
+        // fall through
       default:
+        hash = (hash ^ (uint32_t) PEEK) * FNV_PRIME;
         S_ADVANCE;
         break;
     }
   }
+  chunk:
+  state->indents->comment_depth = depth + 1;
+  MARK("multiline_comment chunk", false, state);
+  return finish(COMMENT, "multiline_comment chunk");
+}
+
+/**
+ * Since {- -} comments can be nested arbitrarily, this has to keep track of how many have been opened, so that the
+ * outermost comment isn't closed prematurely. Only call once we've consumed the `{` of a `{-`.
+ */
+static Result multiline_comment(State *state) {
+  LOG(INFO, "->multiline_comment (col = %u, PEEK = %c)\n", COL, PEEK);
+  return comment_chunk(0, state);
 }
 
 /**
@@ -1280,7 +1693,7 @@ static Result brace(State *state) {
   switch (PEEK) {
     case '{': {
       S_ADVANCE;
-      return doc_block(state);
+      return doc_open(state);
     }
     case '-': return multiline_comment(state);
     default: return res_fail;
@@ -1296,7 +1709,7 @@ static Result brace(State *state) {
  * Parse either inline or block comments. (or fold)
  */
 static Result comment(State *state) {
-  LOG(INFO, "->comment (col = %u, PEEK = %c)\n", state->lexer->get_column(state->lexer), PEEK);
+  LOG(INFO, "->comment (col = %u, PEEK = %c)\n", COL, PEEK);
   switch (PEEK) {
     case '-': {
       Result res = minus(state);
@@ -1315,7 +1728,7 @@ static Result comment(State *state) {
 static Result close_layout_in_list(State *state) {
   switch (PEEK) {
     case ']': {
-      if (state->symbols[END]) {
+      if (SYM(END)) {
         pop(state);
         return finish(END, "bracket");
       }
@@ -1323,7 +1736,7 @@ static Result close_layout_in_list(State *state) {
     }
     case ',': {
       S_ADVANCE;
-      if (state->symbols[COMMA]) {
+      if (SYM(COMMA)) {
         MARK("comma", false, state);
         return finish(COMMA, "comma");
       }
@@ -1372,48 +1785,21 @@ static Result close_layout_in_list(State *state) {
 static Result handle_negative(State *state) {
   LOG(VERBOSE, "->handle_negative; PEEK = %c\n", PEEK);
   if (PEEK != '-' && PEEK != '+') return res_cont;
+  int32_t sign = PEEK;
   S_ADVANCE;
-  return post_pos_neg_sign(state, true);
+  return post_pos_neg_sign(sign, state);
 }
 
-/** Parse special tokens before the first newline that can't be reliably detected by tree-sitter:
- *   TODO revisit whether we want to use `inline_tokens` at all
- *   - `where` here is just for the actual valid token
- *   - `in` closes a layout when inline
- *   - `then` closes a layout when inline
- *   - THIS IS NOT TRUE! '+' closes a layout when inline if END valid `x = 5 + 2`, the + does not close a layout!
- *   - `)` can end the layout of an `of`
- *   - symbolic operators are complicated to implement with regex
- *   - `$` can be a splice if not followed by whitespace
- *   - '[' can be a list or a quasiquote
- *   - '|' in a quasiquote, since it can be followed by symbolic operator characters, which would be consumed
- * TODO: should this handle -> instead of layout_start handling it?
+/**
+ * The part of `inline_tokens` that doesn't involve operators: keywords, closing brackets and comments.
  */
-static Result inline_tokens(State *state) {
-  LOG(INFO, "->inline_tokens (%u, %c)\n", COL, PEEK);
-  // if (PEEK == '+') {
-  //   Result res = layout_end("+", state);
-  //   SHORT_SCANNER;
-  //   return res_fail;
-  // }
+static Result inline_layout_tokens(State *state) {
   switch (PEEK) {
-    case 'w': {
-      Result res = where_or_with(state);
-      SHORT_SCANNER;
-      return res_fail;
-    }
-    case 'i': {
-      Result res = in(state);
-      SHORT_SCANNER;
-      return res_fail;
-    }
-    case 'e': {
-      Result res = else_(state);
-      SHORT_SCANNER;
-      return res_fail;
-    }
+    case 'w':
+    case 'i':
+    case 'e':
     case 't': {
-      Result res = then(state);
+      Result res = keyword_token(state);
       SHORT_SCANNER;
       return res_fail;
     }
@@ -1432,22 +1818,12 @@ static Result inline_tokens(State *state) {
     //   SHORT_SCANNER;
     //   return res_fail;
     // }
-    case '(':
-    SYMBOLIC_CASES: {
-      Result res = operator(state);
-      SHORT_SCANNER;
-      return res_fail;
-    }
     case ',': {
       // There should not be any parsing if you encounter a comma
       return res_fail;
     }
     // TODO(414owen) does this clash with inline comments '--'?
     // I'm not sure why there's a `symbolic::comment` and a `COMMENT`...
-    // SYMBOLICS_WITHOUT_BAR: {
-    //   Symbolic s = read_symop(state);
-    //   return symop(s, state);
-    // }
     // case '|': {
     //   if (state->symbols[QQ_BAR]) {
     //     S_ADVANCE;
@@ -1471,36 +1847,41 @@ static Result inline_tokens(State *state) {
       SHORT_SCANNER;
     }
   }
+  if (SYM(PATH) && path_wordy_start(PEEK)) return path(state);
   return close_layout_in_list(state);
 }
 
-/**
- * Parser for numbers and symops. JS grammar is detecting zero-length nat for some reason.
- * - Nat
- * - Int
- * - Float
- * - Byte
- * Parser must fail if it detects a non-number/byte that begins with digit/decimal,
- * or if it detects a number out of range of permissible values.
+/** Parse special tokens before the first newline that can't be reliably detected by tree-sitter:
+ *   TODO revisit whether we want to use `inline_tokens` at all
+ *   - `where` here is just for the actual valid token
+ *   - `in` closes a layout when inline
+ *   - `then` closes a layout when inline
+ *   - THIS IS NOT TRUE! '+' closes a layout when inline if END valid `x = 5 + 2`, the + does not close a layout!
+ *   - `)` can end the layout of an `of`
+ *   - symbolic operators are complicated to implement with regex
+ *   - numeric literals, so that they can be range checked
+ *   - `$` can be a splice if not followed by whitespace
+ *   - '[' can be a list or a quasiquote
+ *   - '|' in a quasiquote, since it can be followed by symbolic operator characters, which would be consumed
+ * TODO: should this handle -> instead of layout_start handling it?
  */
-static Result numeric(State *state) {
-  return res_cont;
-  LOG(INFO, "->numeric, %c\n", PEEK);
-  Result res = res_cont;
-  switch (PEEK) {
-    case '+':
-    case '-':
-      res = handle_negative(state);
-      SHORT_SCANNER;
-      break;
-    NUMERIC_CASES:
-      res = res_fail;//detect_nat_ufloat_byte(state);
-      SHORT_SCANNER;
-      break;
+static Result inline_tokens(State *state) {
+  LOG(INFO, "->inline_tokens (%u, %c)\n", COL, PEEK);
+  // if (PEEK == '+') {
+  //   Result res = layout_end("+", state);
+  //   SHORT_SCANNER;
+  //   return res_fail;
+  // }
+  if (PEEK == '(' || symbolic(PEEK)) {
+    Result res = operator(state);
+    SHORT_SCANNER;
+    return res_fail;
   }
-  return res;
+  if (is_digit(PEEK)) return number(0, state);
+  return inline_layout_tokens(state);
 }
 
+
 /**
  * If the symbol `START` is valid, starting a new layout is almost always indicated.
  *
@@ -1515,16 +1896,15 @@ static Result numeric(State *state) {
  *
  * This pushes the indentation of the first non-whitespace character onto the stack.
  */
-static Result layout_start(uint32_t column, State *state) {
-    LOG(INFO, "->layout_start (column = %u, col = %u, PEEK = %c)\n", column, COL, PEEK);
-    const uint32_t columna = column;
+static Result layout_start(State *state) {
+    LOG(INFO, "->layout_start (col = %u, PEEK = %c)\n", COL, PEEK);
     uint32_t offset = 0;
 
     // Need to make sure we aren't calculating a layout based on comment col
     LOG(VERBOSE, "[layout_start] before matching START (col = %u, PEEK = %c, sym(START) = %u, sym(GLS) = %u)\n", COL, PEEK, SYM(START), SYM(GUARD_LAYOUT_START));
     if (SYM(GUARD_LAYOUT_START)) {
         if (PEEK == '|') {
-            LOG(VERBOSE, "[layout_start] found GUARD_LAYOUT_START; about to push col = %u\n", columna);
+            LOG(VERBOSE, "[layout_start] found GUARD_LAYOUT_START; about to push col = %u\n", COL);
             MARK("guard_layout_start", false, state);
             push(COL, state);
             return finish(GUARD_LAYOUT_START, "guard_layout_start");
@@ -1547,7 +1927,7 @@ static Result layout_start(uint32_t column, State *state) {
                     return inline_comment(state);
                 }
                 else if (PEEK == '>') {
-                    return res_fail;
+                    return path_after_symbols((Segment) {.length = 1, .first = '-'}, state);
                 } else {
                   ++offset; // So we don't count the '-' as part of the indent
                 }
@@ -1616,7 +1996,7 @@ static Result post_end_semicolon(uint32_t column, State *state) {
  */
 static Result repeat_end(uint32_t column, State *state) {
   LOG(INFO, "->repeat_end(%u, %c)\n", column, PEEK);
-  if (state->symbols[END] && smaller_indent(column, state)) {
+  if (SYM(END) && smaller_indent(column, state)) {
     LOG(VERBOSE, "[repeat_end] end available, is smaller indent, so returning END\n");
     return layout_end("repeat_end", state);
   }
@@ -1648,35 +2028,32 @@ static Result newline_token(uint32_t indent, State *state) {
   if (PEEK == '-') {
     return minus(state);
   }
-  switch (PEEK) {
-    NUMERIC_CASES: {
-      Result res = numeric(state);
+  if (symbolic(PEEK) || PEEK == '`') {
+    if (PEEK == '+') {
+      Result res = handle_negative(state);
       SHORT_SCANNER;
-      break;
-    }
-    SYMBOLIC_CASES:
-    case '`': {
-      if (PEEK == '+') {
-        Result res = handle_negative(state);
-        SHORT_SCANNER;
-      } else if (PEEK == '>') {
-        S_ADVANCE;
-        if (!symbolic(PEEK)) {
-          MARK("newline_token", false, state);
-          return finish_if_valid(WATCH, "watch", state);
-        }
+    } else if (PEEK == '>') {
+      S_ADVANCE;
+      if (!symbolic(PEEK)) {
+        MARK("newline_token", false, state);
+        return finish_if_valid(WATCH, "watch", state);
       }
-      return res_fail;
-    }
-    case 'w': {
-      Result res = where_or_with(state);
-      SHORT_SCANNER;
+      return path_after_symbols((Segment) {.length = 1, .first = '>'}, state);
+    } else if (SYM(PATH) || (PEEK == '.' && SYM(FLOAT))) {
+      return path(state);
     }
+    return res_fail;
   }
-  // NOTE: "where" cannot begin a new line in Unison, just Haskell
-  // Result res = newline_where(indent, state);
-  // SHORT_SCANNER;
-  if (PEEK == 'i') return in(state);
+  switch (PEEK) {
+    NUMERIC_CASES:
+      // Digits can't start a path, so a failed number is not one either.
+      return number(0, state);
+    // NOTE: "where" cannot begin a new line in Unison, just Haskell, but `with` and `in` can
+    case 'w':
+    case 'i':
+      return keyword_token(state);
+  }
+  if (SYM(PATH) && path_wordy_start(PEEK)) return path(state);
   return res_cont;
 }
 
@@ -1687,8 +2064,9 @@ static Result newline(uint32_t indent, State *state) {
   LOG(INFO, "->newline(%u)\n", indent);
   Result res = eof(state);
   SHORT_SCANNER;
-  if(SYM(START) || SYM(GUARD_LAYOUT_START)) {
-    Result res = layout_start(indent, state);
+  // `START` has been decided by `init` already.
+  if (PEEK == '|' && SYM(GUARD_LAYOUT_START)) {
+    Result res = layout_start(state);
     SHORT_SCANNER;
   }
   // res = initialize(indent, state);
@@ -1698,7 +2076,7 @@ static Result newline(uint32_t indent, State *state) {
   res = newline_indent(indent, state);
   SHORT_SCANNER;
 
-  // fix for #94 - otherwise will scan for DOC_BLOCK before use-clause, line-ending SEMICOLON
+  // fix for #94 - otherwise will scan for DOC_OPEN before use-clause, line-ending SEMICOLON
   res = comment(state);
   SHORT_SCANNER;
 
@@ -1710,22 +2088,29 @@ static Result newline(uint32_t indent, State *state) {
 /**
  * Parsers that have to run when the next non-space character is not a newline:
  *
- *   - Layout start
+ *   - Guard layout start (`|`)
  *   - ending nested layouts at the same position
- *   - numeric literals + symops
+ *   - symops
  *   - Tokens `where`, `with`, `in`, `$`, `)`, `]`, `,`
  *   - comments
+ *
+ * The column is only asked for when a parser that compares it can match.
  */
-static Result immediate(uint32_t column, State *state) {
+static Result immediate(State *state) {
   LOG(INFO, "->immediate (col = %u, PEEK = %c)\n", COL, PEEK);
-  Result res = layout_start(column, state);
-  SHORT_SCANNER;
-  res = post_end_semicolon(column, state);
-  SHORT_SCANNER;
-  res = repeat_end(column, state);
-  SHORT_SCANNER;
-  res = numeric(state);
-  SHORT_SCANNER;
+  Result res;
+  // `START` has been decided by `init` already.
+  if (PEEK == '|' && SYM(GUARD_LAYOUT_START)) {
+    res = layout_start(state);
+    SHORT_SCANNER;
+  }
+  if (indent_exists(state) && (SYM(SEMICOLON) || SYM(END))) {
+    uint32_t column = COL;
+    res = post_end_semicolon(column, state);
+    SHORT_SCANNER;
+    res = repeat_end(column, state);
+    SHORT_SCANNER;
+  }
   return inline_tokens(state);
 }
 
@@ -1733,9 +2118,9 @@ static Result immediate(uint32_t column, State *state) {
  * Parsers that have to run _before_ parsing whitespace:
  *
  *   - Error check
- *   - Indent stack initialization
- *   - Qualified module dot (leading whitespace would mean it would be `(.)`)
- *   - Fold
+ *   - Indent stack initialization, which decides the result whenever `START` is valid
+ *   - Hash cid or cycle (`#`, `.`; leading whitespace would make the dot `(.)`)
+ *   - Fold (`-`)
  */
 static Result init(State *state) {
   LOG(INFO, "->init (col = %u, PEEK = %c)\n", COL, PEEK);
@@ -1746,31 +2131,24 @@ static Result init(State *state) {
   Result res = eof(state);
   SHORT_SCANNER;
 
-
-  // res = after_error(state) ? res_fail : res_cont;
-  // SHORT_SCANNER;
   /**
    * It is almost always the right thing to do to start
    * a new layout if it's possible
    */
   if (SYM(START)) {
-      uint32_t indent = count_indent(state);
-      res = layout_start(indent, state);
-      SHORT_SCANNER;
+      count_indent(state);
+      return layout_start(state);
   }
 
-  // res = initialize_init(state);
-  // SHORT_SCANNER;
-  res = hash(state);
-  SHORT_SCANNER;
-  if (SYM(FOLD) && PEEK == '-') {
-    res = fold(state);
-    SHORT_SCANNER;
+  switch (PEEK) {
+    case '#':
+    case '.':
+      return hash(state);
+    case '-':
+      // A failed fold has consumed the `-`, and scanning continues after it.
+      if (SYM(FOLD)) return fold(state);
+      break;
   }
-
-  // if (state->symbols[QQ_BODY]) {
-    // return qq_body(state);
-  // }
   return res_cont;
 }
 
@@ -1789,12 +2167,11 @@ static Result scan_main(State *state) {
     uint32_t indent = count_indent(state);
     return newline(indent, state);
   }
-  uint32_t col = column(state);
-  return immediate(col, state);
+  return immediate(state);
 }
 
 /**
- * The entry point to the parser.
+ * The entry point to the parser, for valid-symbol sets without a specialized path (see `scan_path`).
  */
 static Result scan_all(State *state) {
   LOG(INFO, "->scan_all (%u, %c)\n", COL, PEEK);
@@ -1803,6 +2180,164 @@ static Result scan_all(State *state) {
   return scan_main(state);
 }
 
+// --------------------------------------------------------------------------------------------------------
+// Specialized scan paths
+// --------------------------------------------------------------------------------------------------------
+
+/**
+ * Only a few of the externals are referenced by grammar rules, and `comment` is an extra, so it is valid nearly
+ * everywhere. The parse tables therefore produce a small number of distinct valid-symbol sets, and
+ * `script/valid-symbol-histogram` shows which of them occur most on real code.
+ *
+ * Each of the paths below is `scan_all` with the branches for symbols outside its set removed, so it has to produce
+ * exactly the same result as `scan_all` for any input it is dispatched to. Anything else takes the generic path.
+ */
+#define COMMENT_SYMS (SYM_BIT(COMMENT) | SYM_BIT(DOC_OPEN))
+#define LAYOUT_SYMS (COMMENT_SYMS | SYM_BIT(SEMICOLON) | SYM_BIT(END))
+#define NUMBER_SYMS (SYM_BIT(NAT) | SYM_BIT(INT) | SYM_BIT(FLOAT) | SYM_BIT(HEX) | SYM_BIT(BYTES))
+#define OPERATOR_SYMS (COMMENT_SYMS | NUMBER_SYMS | SYM_BIT(PATH) | SYM_BIT(SYMOP) | SYM_BIT(PREFIX_SYMOP) | SYM_BIT(WATCH))
+
+/**
+ * Only comments and doc blocks: nothing on the line can succeed except `{-` or `{{`, and after a newline also `--`.
+ * No column is needed.
+ */
+static Result scan_comments(State *state) {
+  LOG(INFO, "->scan_comments (%c)\n", PEEK);
+  skipspace(state);
+  if (is_newline(PEEK)) {
+    S_SKIP;
+    count_indent(state);
+    return comment(state);
+  }
+  return PEEK == '{' ? comment(state) : res_fail;
+}
+
+/**
+ * Layout semicolons and ends: no layout starts, hashes, folds or operators. An operator can't succeed, so it isn't
+ * scanned, and the column is only needed when there is a layout to compare it with.
+ */
+static Result scan_layout(State *state) {
+  LOG(INFO, "->scan_layout (%c)\n", PEEK);
+  Result res = eof(state);
+  SHORT_SCANNER;
+  skipspace(state);
+  res = eof(state);
+  SHORT_SCANNER;
+  MARK("main", false, state);
+  if (is_newline(PEEK)) {
+    S_SKIP;
+    uint32_t indent = count_indent(state);
+    return newline(indent, state);
+  }
+  if (indent_exists(state)) {
+    uint32_t col = column(state);
+    res = post_end_semicolon(col, state);
+    SHORT_SCANNER;
+    res = repeat_end(col, state);
+    SHORT_SCANNER;
+  }
+  if (PEEK == '(' || symbolic(PEEK)) return res_fail;
+  return inline_layout_tokens(state);
+}
+
+/**
+ * Operators and numbers: nothing depends on the indent, so the column is only needed for a watch.
+ */
+static Result scan_operator(State *state) {
+  LOG(INFO, "->scan_operator (%c)\n", PEEK);
+  skipspace(state);
+  Result res = eof(state);
+  SHORT_SCANNER;
+  MARK("main", false, state);
+  if (is_newline(PEEK)) {
+    S_SKIP;
+    uint32_t indent = count_indent(state);
+    return newline(indent, state);
+  }
+  return inline_tokens(state);
+}
+
+/**
+ * The rest of a fold (see `fold_chunk`). The continuation is only valid directly after a chunk of a fold, and a fold
+ * reaches to the end of the file, so whatever follows is part of it.
+ */
+static Result scan_fold(State *state) {
+  LOG(INFO, "->scan_fold\n");
+  if (PEEK == 0 && is_eof(state)) return scan_all(state);
+  fold_chunk(state);
+  MARK("fold", false, state);
+  return finish(FOLD_CONTINUATION, "fold continuation");
+}
+
+/**
+ * The contents of a doc block, after its `{{`. A doc block is scanned as a sequence of tokens that each end at a line
+ * break, before a nested `{{` or at the `}}` that closes it, so that an edit only re-lexes the lines around it. Nested
+ * doc blocks are matched by the grammar, which lets the scanner get by without tracking the depth.
+ *
+ * Like `{{` and `}}`, any other brace is consumed together with the character after it, so `{}}` doesn't close a block.
+ * Fenced code and directives like `@source{...}` are split into lines like all other text.
+ */
+#define DOC_CHUNK_MAX 1024
+
+static Result scan_doc(State *state) {
+  LOG(INFO, "->scan_doc\n");
+  for (uint32_t length = 0; length < DOC_CHUNK_MAX; length++) {
+    if (PEEK == 0 && is_eof(state)) {
+      if (length == 0) return res_fail;
+      break;
+    }
+    int32_t c = PEEK;
+    if (c == '{' || c == '}') {
+      MARK("doc text", false, state);
+      S_ADVANCE;
+      if (PEEK == c) {
+        if (length > 0) return finish(DOC_TEXT, "doc text");
+        S_ADVANCE;
+        MARK("doc brace", false, state);
+        return c == '{' ? finish(DOC_OPEN, "doc open") : finish(DOC_CLOSE, "doc close");
+      }
+      S_ADVANCE;
+      length++;
+      continue;
+    }
+    S_ADVANCE;
+    if (c == '\n') break;
+  }
+  MARK("doc text", false, state);
+  return finish(DOC_TEXT, "doc text");
+}
+
+/**
+ * The rest of a multiline comment that didn't fit into the previous token (see `comment_chunk`). Whatever the parser
+ * expects, the comment has to be finished first.
+ */
+static Result scan_comment(State *state) {
+  LOG(INFO, "->scan_comment\n");
+  return comment_chunk(state->indents->comment_depth - 1, state);
+}
+
+/**
+ * After an error, the parser asks for all symbols at once (see `after_error`), and everything but numbers and paths is
+ * left to the grammar. Those are only lexed here, so without this an unsigned number or a qualified name in broken code
+ * would be skipped character by character instead of becoming a token.
+ */
+static Result scan_recovery(State *state) {
+  LOG(INFO, "->scan_recovery\n");
+  while (isws(PEEK)) S_SKIP;
+  return is_digit(PEEK) ? number(0, state) : path(state);
+}
+
+typedef Result (*ScanPath)(State *state);
+
+static ScanPath scan_path(uint32_t valid) {
+  if ((valid & SYM_BIT(FOLD_CONTINUATION)) && !all_syms(valid)) return scan_fold;
+  if ((valid & SYM_BIT(DOC_TEXT)) && !all_syms(valid)) return scan_doc;
+  if ((valid & ~COMMENT_SYMS) == 0) return scan_comments;
+  if ((valid & ~LAYOUT_SYMS) == 0) return scan_layout;
+  if ((valid & ~OPERATOR_SYMS) == 0) return scan_operator;
+  return scan_all;
+}
+
 // --------------------------------------------------------------------------------------------------------
 // Evaluation
 // --------------------------------------------------------------------------------------------------------
@@ -1846,7 +2381,10 @@ static bool eval(Result (*chk)(State *state), State *state) {
   debug_lookahead(state);
 #endif
   if (result.finished && result.sym != FAIL) {
-#ifdef DEBUG
+#ifdef UNISON_SCANNER_DECISIONS
+    state->decided_by = result.by;
+#endif
+#if DEBUG
     // TODO(414owen) can names[] fail?
     if (state->marked == -1) {
       LOG(VERBOSE, "%d\n", column(state));
@@ -1860,6 +2398,151 @@ static bool eval(Result (*chk)(State *state), State *state) {
   } else return false;
 }
 
+// --------------------------------------------------------------------------------------------------------
+// Statistics
+// --------------------------------------------------------------------------------------------------------
+
+/**
+ * `TreeSitterUnisonScannerStats` is indexed by `Sym`, with `FAIL` for the total, under the public names of
+ * `TreeSitterUnisonSymbol`.
+ */
+_Static_assert((int) FAIL == TREE_SITTER_UNISON_SYM_TOTAL, "TreeSitterUnisonSymbol is out of sync with Sym");
+_Static_assert(
+  (int) SEMICOLON == TREE_SITTER_UNISON_SYM_SEMICOLON &&
+  (int) START == TREE_SITTER_UNISON_SYM_START &&
+  (int) END == TREE_SITTER_UNISON_SYM_END &&
+  (int) DOT == TREE_SITTER_UNISON_SYM_DOT &&
+  (int) WHERE == TREE_SITTER_UNISON_SYM_WHERE &&
+  (int) VARSYM == TREE_SITTER_UNISON_SYM_VARSYM &&
+  (int) COMMENT == TREE_SITTER_UNISON_SYM_COMMENT &&
+  (int) FOLD == TREE_SITTER_UNISON_SYM_FOLD &&
+  (int) COMMA == TREE_SITTER_UNISON_SYM_COMMA &&
+  (int) IN == TREE_SITTER_UNISON_SYM_IN &&
+  (int) INDENT == TREE_SITTER_UNISON_SYM_INDENT &&
+  (int) EMPTY == TREE_SITTER_UNISON_SYM_EMPTY &&
+  (int) SYMOP == TREE_SITTER_UNISON_SYM_SYMOP &&
+  (int) PREFIX_SYMOP == TREE_SITTER_UNISON_SYM_PREFIX_SYMOP &&
+  (int) WATCH == TREE_SITTER_UNISON_SYM_WATCH &&
+  (int) START_AND_ARROW == TREE_SITTER_UNISON_SYM_START_AND_ARROW &&
+  (int) OCTOTHORPE == TREE_SITTER_UNISON_SYM_OCTOTHORPE &&
+  (int) DOC_OPEN == TREE_SITTER_UNISON_SYM_DOC_OPEN &&
+  (int) GUARD_LAYOUT_START == TREE_SITTER_UNISON_SYM_GUARD_LAYOUT_START &&
+  (int) DESTRUCTURE_START == TREE_SITTER_UNISON_SYM_DESTRUCTURE_START &&
+  (int) FOLD_CONTINUATION == TREE_SITTER_UNISON_SYM_FOLD_CONTINUATION &&
+  (int) DOC_CLOSE == TREE_SITTER_UNISON_SYM_DOC_CLOSE &&
+  (int) DOC_TEXT == TREE_SITTER_UNISON_SYM_DOC_TEXT &&
+  (int) NAT == TREE_SITTER_UNISON_SYM_NAT &&
+  (int) INT == TREE_SITTER_UNISON_SYM_INT &&
+  (int) FLOAT == TREE_SITTER_UNISON_SYM_FLOAT &&
+  (int) HEX == TREE_SITTER_UNISON_SYM_HEX &&
+  (int) BYTES == TREE_SITTER_UNISON_SYM_BYTES &&
+  (int) PATH == TREE_SITTER_UNISON_SYM_PATH,
+  "TreeSitterUnisonSymbol is out of sync with Sym");
+
+#ifdef UNISON_SCANNER_STATS
+static TreeSitterUnisonScannerStats scanner_stats;
+
+static bool stats_note(bool found, State *state) {
+  Sym result = found ? (Sym) state->lexer->result_symbol : FAIL;
+  bool recovering = after_error(state);
+  for (Sym s = 0; s <= FAIL; s++) {
+    if (!SYM(s) && s != FAIL) continue;
+    TreeSitterUnisonSymbolStats *stats = &scanner_stats.symbols[s];
+    stats->calls++;
+    stats->failures += !found;
+    stats->after_error += recovering;
+  }
+  TreeSitterUnisonSymbolStats *stats = &scanner_stats.symbols[result];
+  stats->successes += found;
+  stats->advanced += state->advanced;
+  bool marked = found && state->advanced_at_mark != UINT32_MAX;
+  stats->wasted += marked ? state->advanced - state->advanced_at_mark : found ? 0 : state->advanced;
+  stats->max_indents = MAX(stats->max_indents, state->indents->len);
+  return found;
+}
+#define STATS_NOTE(found, state) stats_note((found), (state))
+#else
+#define STATS_NOTE(found, state) (found)
+#endif
+
+// --------------------------------------------------------------------------------------------------------
+// Decision trace
+// --------------------------------------------------------------------------------------------------------
+
+/**
+ * Built with `-DUNISON_SCANNER_DECISIONS`, every call leaves a 16 byte record in a ring buffer of the last
+ * `UNISON_SCANNER_DECISION_EVENTS` calls, which `tree_sitter_unison_decision_trace_dump` writes out in a binary format
+ * for `script/decode-decisions`. Recording is a few stores, so unlike the trace build it can stay on under load.
+ *
+ * The scanner doesn't know its offset in the file, and asking for the column would make tokens harder to reuse, so a
+ * call is identified by its number and the character it starts at instead. The runtime's `lex_external` log lines
+ * give the positions, one per call, if they are needed. Like the statistics, the buffer is shared by all scanners in
+ * the process.
+ */
+#ifdef UNISON_SCANNER_DECISIONS
+#ifndef UNISON_SCANNER_DECISION_EVENTS
+#define UNISON_SCANNER_DECISION_EVENTS 4096
+#endif
+#define DECIDER_SLOTS 128
+#define DECISION_TRACE_VERSION 1
+
+typedef struct {
+    uint32_t call; // number of the call since the trace was last reset
+    uint32_t valid; // see `SYM_BIT`
+    uint32_t lookahead; // the character the call started at (21 bits) and the depth of the indent stack (11 bits)
+    uint16_t length; // characters advanced over up to the end of the token, or all of them for a failure
+    uint16_t decision; // the resulting `Sym` (5 bits), the scan path (3 bits) and the decider (8 bits)
+} Decision;
+
+static Decision decisions[UNISON_SCANNER_DECISION_EVENTS];
+static uint32_t decision_calls;
+
+/**
+ * The `desc` of the `finish` calls that decided, by slot. Slots are found by the address of the string, which is the
+ * same for every call from the same place, so no string is ever compared. Slot 0 stands for none, so for failures, and
+ * for any other decider once the table is full.
+ */
+static const char *decision_deciders[DECIDER_SLOTS];
+
+static const ScanPath decision_paths[] = {scan_comment, scan_recovery, scan_fold, scan_doc, scan_comments, scan_layout,
+  scan_operator, scan_all};
+
+static uint32_t decider_slot(const char *by) {
+  if (by == NULL) return 0;
+  uint32_t slot = (uint32_t) ((uintptr_t) by >> 3) % (DECIDER_SLOTS - 1) + 1;
+  for (uint32_t probes = 0; probes < DECIDER_SLOTS - 1; probes++) {
+    if (decision_deciders[slot] == NULL) decision_deciders[slot] = by;
+    if (decision_deciders[slot] == by) return slot;
+    slot = slot % (DECIDER_SLOTS - 1) + 1;
+  }
+  return 0;
+}
+
+static void decision_note(bool found, ScanPath path, int32_t lookahead, uint32_t indents, State *state) {
+  uint32_t p = 0;
+  while (decision_paths[p] != path) p++;
+  Sym sym = found ? (Sym) state->lexer->result_symbol : FAIL;
+  uint32_t length = found && state->advanced_at_mark != UINT32_MAX ? state->advanced_at_mark : state->advanced;
+  decisions[decision_calls % UNISON_SCANNER_DECISION_EVENTS] = (Decision) {
+    .call = decision_calls,
+    .valid = state->valid,
+    .lookahead = ((uint32_t) lookahead & 0x1fffff) | MIN(indents, 0x7ff) << 21,
+    .length = MIN(length, UINT16_MAX),
+    .decision = sym | p << 5 | decider_slot(found ? state->decided_by : NULL) << 8,
+  };
+  decision_calls++;
+}
+#define DECISION_NOTE(found, path, lookahead, indents, state) \
+  decision_note((found), (path), (lookahead), (indents), (state))
+
+static uint32_t put_u32(char *buffer, uint32_t pos, uint32_t v) {
+  for (int i = 0; i < 4; i++) buffer[pos + i] = (char) (v >> (8 * i));
+  return pos + 4;
+}
+#else
+#define DECISION_NOTE(found, path, lookahead, indents, state) do {} while (0)
+#endif
+
 // ----------
 // API
 // ----------
@@ -1868,63 +2551,294 @@ static bool eval(Result (*chk)(State *state), State *state) {
  * This function allocates the persistent state of the parser that is passed into the other API functions.
  */
 void *tree_sitter_unison_external_scanner_create() {
-  void *res = calloc(sizeof(indent_vec), 1);
+  indent_vec *res = ts_calloc(1, sizeof(indent_vec));
+  res->data = res->inline_data;
+  res->cap = INDENT_INLINE_CAPACITY;
+  ALLOC_NOTE(res, 0, sizeof(indent_vec));
   return res;
 }
 
+/**
+ * Report the memory a scanner holds through the allocator hooks. All zeros unless built with
+ * `-DUNISON_SCANNER_ALLOC_STATS`.
+ */
+TreeSitterUnisonAllocations tree_sitter_unison_external_scanner_allocations(const void *indents_v) {
+#ifdef UNISON_SCANNER_ALLOC_STATS
+  return ((const indent_vec*) indents_v)->allocations;
+#else
+  (void) indents_v;
+  return (TreeSitterUnisonAllocations) {0};
+#endif
+}
+
+/**
+ * Report the memory all scanners in the process hold through the allocator hooks, for embedders that only have a
+ * `TSParser`. All zeros unless built with `-DUNISON_SCANNER_ALLOC_STATS`.
+ */
+TreeSitterUnisonAllocations tree_sitter_unison_scanner_allocations(void) {
+#ifdef UNISON_SCANNER_ALLOC_STATS
+  return scanner_allocations;
+#else
+  return (TreeSitterUnisonAllocations) {0};
+#endif
+}
+
+/**
+ * Read the counters of all scanners since the library was loaded or they were last reset. All zeros unless built
+ * with `-DUNISON_SCANNER_STATS`. The counters are a non-atomic process global, so concurrent parsers make them
+ * unreliable.
+ */
+TreeSitterUnisonScannerStats tree_sitter_unison_scanner_stats(void) {
+#ifdef UNISON_SCANNER_STATS
+  return scanner_stats;
+#else
+  return (TreeSitterUnisonScannerStats) {0};
+#endif
+}
+
+void tree_sitter_unison_scanner_stats_reset(void) {
+#ifdef UNISON_SCANNER_STATS
+  scanner_stats = (TreeSitterUnisonScannerStats) {0};
+#endif
+}
+
+/**
+ * Write the decision trace to `buffer`, oldest call first, if it has room for it, and return its size either way.
+ * Always 0 unless built with `-DUNISON_SCANNER_DECISIONS`. All numbers are little-endian:
+ *
+ *   "UNDT" | version (1 byte) | deciders (1 byte) | calls (4 bytes) | records (4 bytes)
+ *   deciders times: slot (1 byte) | length (1 byte) | name
+ *   records times: call (4) | valid symbols (4) | lookahead and indents (4) | length (2) | decision (2)
+ *
+ * `calls` counts all calls since the last reset, of which the last `records` are in the trace.
+ */
+uint32_t tree_sitter_unison_decision_trace_dump(char *buffer, uint32_t size) {
+#ifdef UNISON_SCANNER_DECISIONS
+  uint32_t records = decision_calls < UNISON_SCANNER_DECISION_EVENTS ? decision_calls : UNISON_SCANNER_DECISION_EVENTS;
+  uint32_t deciders = 0, needed = 14 + records * 16;
+  for (uint32_t slot = 1; slot < DECIDER_SLOTS; slot++) {
+    if (decision_deciders[slot] == NULL) continue;
+    deciders++;
+    needed += 2 + MIN(strlen(decision_deciders[slot]), 255);
+  }
+  if (size < needed) return needed;
+  uint32_t pos = 0;
+  memcpy(buffer, "UNDT", 4);
+  buffer[4] = DECISION_TRACE_VERSION;
+  buffer[5] = (char) deciders;
+  pos = put_u32(buffer, 6, decision_calls);
+  pos = put_u32(buffer, pos, records);
+  for (uint32_t slot = 1; slot < DECIDER_SLOTS; slot++) {
+    if (decision_deciders[slot] == NULL) continue;
+    uint32_t length = MIN(strlen(decision_deciders[slot]), 255);
+    buffer[pos++] = (char) slot;
+    buffer[pos++] = (char) length;
+    memcpy(buffer + pos, decision_deciders[slot], length);
+    pos += length;
+  }
+  for (uint32_t i = decision_calls - records; i != decision_calls; i++) {
+    Decision *d = &decisions[i % UNISON_SCANNER_DECISION_EVENTS];
+    pos = put_u32(buffer, pos, d->call);
+    pos = put_u32(buffer, pos, d->valid);
+    pos = put_u32(buffer, pos, d->lookahead);
+    pos = put_u32(buffer, pos, d->length | (uint32_t) d->decision << 16);
+  }
+  return needed;
+#else
+  (void) buffer;
+  (void) size;
+  return 0;
+#endif
+}
+
+void tree_sitter_unison_decision_trace_reset(void) {
+#ifdef UNISON_SCANNER_DECISIONS
+  decision_calls = 0;
+  memset(decision_deciders, 0, sizeof(decision_deciders));
+#endif
+}
+
 /**
  * Main logic entry point.
  * Since the state is a singular vector, it can just be cast and used directly.
  */
 bool tree_sitter_unison_external_scanner_scan(void *indents_v, TSLexer *lexer, const bool *syms) {
   indent_vec *indents = (indent_vec*) indents_v;
-  State state = {
-    .lexer = lexer,
-    .symbols = syms,
-    .indents = indents
-  };
+  State state = state_new(lexer, syms, indents);
   LOG(WARN, "===================\nBeginning scanner\n");
   debug_state(&state);
 #if DEBUG
-  if (state.needs_free) free(state.marked_by);
+  if (state.needs_free) ts_free(state.marked_by);
 #endif
-  if (after_error(&state)) {
-      LOG(INFO, "After error. Short-circuiting to fail.\n");
-      return false;
+#if defined(UNISON_SCANNER_VALID_SYMBOLS) && !defined(__wasm32__)
+  fprintf(stderr, "valid_symbols %#x\n", state.valid);
+#endif
+#if defined(UNISON_SCANNER_RECORD) && !defined(__wasm32__)
+  // The state a call starts from, for `script/record-scans`: valid symbols, comment depth and the indent stack.
+  fprintf(stderr, "scanner_call %#x %u", state.valid, indents->comment_depth);
+  for (uint32_t i = 0; i < indents->len; i++) fprintf(stderr, " %u", indents->data[i]);
+  fprintf(stderr, "\n");
+#endif
+#ifdef UNISON_SCANNER_DECISIONS
+  int32_t lookahead = lexer->lookahead;
+  uint32_t depth = indents->len;
+#endif
+  ScanPath path;
+  if (indents->comment_depth > 0) path = scan_comment;
+  else if (after_error(&state)) {
+      LOG(INFO, "After error. Only scanning numbers.\n");
+      path = scan_recovery;
   }
-  bool res = eval(scan_all, &state);
+  else path = scan_path(state.valid);
+  bool res = STATS_NOTE(eval(path, &state), &state);
+  DECISION_NOTE(res, path, lookahead, depth, &state);
+#if DEBUG
+  assert(state.column_queries <= 1);
+#endif
   LOG(WARN, "End scanner with %s and symbol %s\n", res ? "success" : "failure", state.lexer->result_symbol ? sym_names[state.lexer->result_symbol] : "(none)");
   return res;
 }
 
+// --------------------------------------------------------------------------------------------------------
+// Serialization
+// --------------------------------------------------------------------------------------------------------
+
+/**
+ * The serialized state is the comment depth (see `comment_depth`) and the indent stack, outermost layout first:
+ *
+ *   version (1 byte) | comment depth (varint) | number of omitted outer layouts (varint) | indent deltas (zigzag varints)
+ *
+ * Each indent is stored as the difference to the one before it (the first to 0), so the usual small steps of nested
+ * layouts take a single byte each and a 1024 byte buffer holds about a thousand levels.
+ * If the stack still doesn't fit, the outermost layouts are dropped rather than the whole state, since scanning only
+ * ever looks at the innermost ones. They come back with the column of the outermost layout that was kept, so a line
+ * left of all of them, like the next definition at column 0, still ends them all. Only a line that goes back to a
+ * column between two dropped layouts gets different tokens than with the whole stack: it ends all of them as well.
+ * At most `OMITTED_LAYOUTS_MAX` layouts are restored, and a buffer claiming more is not trusted.
+ */
+#define SERIALIZATION_VERSION 2
+#define OMITTED_LAYOUTS_MAX 65536
+
+static unsigned varint_size(uint64_t v) {
+  unsigned size = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    size++;
+  }
+  return size;
+}
+
+static unsigned varint_write(uint64_t v, char *buffer) {
+  unsigned i = 0;
+  while (v >= 0x80) {
+    buffer[i++] = (char) (v | 0x80);
+    v >>= 7;
+  }
+  buffer[i++] = (char) v;
+  return i;
+}
+
+/**
+ * Read a varint starting at `*pos`, advancing `*pos`. Returns false if the buffer ends in the middle of it.
+ */
+static bool varint_read(const char *buffer, unsigned length, unsigned *pos, uint64_t *v) {
+  uint64_t result = 0;
+  for (unsigned shift = 0; *pos < length && shift < 64; shift += 7) {
+    uint8_t byte = (uint8_t) buffer[(*pos)++];
+    result |= (uint64_t) (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t zigzag(int64_t v) { return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63); }
+
+static int64_t unzigzag(uint64_t v) { return (int64_t) (v >> 1) ^ -(int64_t) (v & 1); }
+
+static uint64_t indent_delta(indent_vec *indents, uint32_t i, uint32_t first) {
+  return zigzag((int64_t) indents->data[i] - (i == first ? 0 : (int64_t) indents->data[i - 1]));
+}
+
+/**
+ * The number of outer layouts that have to be dropped for the stack to fit into the serialization buffer.
+ */
+static uint32_t omitted_layouts(indent_vec *indents) {
+  unsigned size = 1 + varint_size(indents->comment_depth) + varint_size(0);
+  for (uint32_t i = 0; i < indents->len; i++) size += varint_size(indent_delta(indents, i, 0));
+  uint32_t omitted = 0;
+  while (size > TREE_SITTER_SERIALIZATION_BUFFER_SIZE) {
+    size -= varint_size(indent_delta(indents, omitted, omitted)) + varint_size(omitted);
+    omitted++;
+    if (omitted < indents->len) {
+      size -= varint_size(indent_delta(indents, omitted, omitted - 1));
+      size += varint_size(indent_delta(indents, omitted, omitted));
+    }
+    size += varint_size(omitted);
+  }
+  return omitted;
+}
+
 /**
  * Copy the current state to another location for later reuse.
- * This is normally more complex, but since this parser's state constists solely of a vector of integers, it can just be
- * copied.
  */
 unsigned tree_sitter_unison_external_scanner_serialize(void *indents_v, char *buffer) {
   indent_vec *indents = (indent_vec*) indents_v;
-  unsigned to_copy = sizeof(indents->data[0]) * indents->len;
-  if (to_copy > TREE_SITTER_SERIALIZATION_BUFFER_SIZE) {
-    return 0;
+  if (indents->len == 0 && indents->comment_depth == 0) return 0;
+  // An indent takes at most 5 bytes, so only deep stacks have to be measured first.
+  uint32_t omitted = 0;
+  if (7 + 5 * (size_t) indents->len > TREE_SITTER_SERIALIZATION_BUFFER_SIZE) omitted = omitted_layouts(indents);
+  unsigned pos = 0;
+  buffer[pos++] = SERIALIZATION_VERSION;
+  pos += varint_write(indents->comment_depth, buffer + pos);
+  pos += varint_write(omitted < OMITTED_LAYOUTS_MAX ? omitted : OMITTED_LAYOUTS_MAX, buffer + pos);
+  // `buffer` may alias the stack as far as the compiler knows, so the loops keep everything in locals.
+  const uint32_t *data = indents->data;
+  int64_t previous = 0;
+  for (uint32_t i = omitted, len = indents->len; i < len; i++) {
+    uint64_t delta = zigzag((int64_t) data[i] - previous);
+    previous = data[i];
+    // Nearly all deltas fit into a single byte.
+    if (delta < 0x80) buffer[pos++] = (char) delta;
+    else pos += varint_write(delta, buffer + pos);
   }
-  memcpy(buffer, indents->data, to_copy);
-  return to_copy;
+  return pos;
 }
 
 /**
  * Load another parser state into the currently active state.
  * `payload` is the state of the previous parser execution, while `buffer` is the saved state of a different position
  * (e.g. when doing incremental parsing).
+ * An empty or unreadable buffer means an empty stack outside of comments.
  */
 void tree_sitter_unison_external_scanner_deserialize(void *indents_v, char *buffer, unsigned length) {
   indent_vec *indents = (indent_vec*) indents_v;
-  unsigned els = length / sizeof(indents->data[0]);
-  if (els > 0) {
-    VEC_GROW(indents, els);
-    indents->len = els;
-    memcpy(indents->data, buffer, length);
+  indents->len = 0;
+  indents->comment_depth = 0;
+  if (length == 0 || buffer[0] != SERIALIZATION_VERSION) return;
+  unsigned pos = 1;
+  uint64_t depth, omitted;
+  if (!varint_read(buffer, length, &pos, &depth) || !varint_read(buffer, length, &pos, &omitted)) return;
+  // Every varint ends in a byte below 0x80, so a buffer that doesn't is cut off.
+  if (depth > UINT32_MAX || omitted > OMITTED_LAYOUTS_MAX || (uint8_t) buffer[length - 1] >= 0x80) return;
+  // Every delta takes at least one byte.
+  VEC_GROW(indents, (uint32_t) omitted + (length - pos));
+  uint32_t *data = indents->data;
+  uint32_t len = (uint32_t) omitted;
+  int64_t indent = 0;
+  uint64_t delta;
+  while (pos < length) {
+    if ((uint8_t) buffer[pos] < 0x80) delta = (uint8_t) buffer[pos++];
+    else if (!varint_read(buffer, length, &pos, &delta)) break;
+    indent += unzigzag(delta);
+    data[len++] = (uint32_t) indent;
   }
+  uint32_t outermost = len > omitted ? data[omitted] : 0;
+  for (uint32_t i = 0; i < omitted; i++) data[i] = outermost;
+  indents->len = len;
+  indents->comment_depth = (uint32_t) depth;
 }
 
 /**
@@ -1932,8 +2846,11 @@ void tree_sitter_unison_external_scanner_deserialize(void *indents_v, char *buff
  */
 void tree_sitter_unison_external_scanner_destroy(void *indents_v) {
   indent_vec *indents = (indent_vec*) indents_v;
+#ifdef UNISON_SCANNER_ALLOC_STATS
+  scanner_allocations.bytes -= indents->allocations.bytes;
+#endif
   VEC_FREE(indents);
-  free(indents);
+  ts_free(indents);
 }
 
 // For unit tests
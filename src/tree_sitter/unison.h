@@ -0,0 +1,119 @@
+#ifndef TREE_SITTER_UNISON_H_
+#define TREE_SITTER_UNISON_H_
+
+/**
+ * Diagnostics of the Unison external scanner for embedders. Each of them is compiled in by a flag and reads as zeros
+ * without it, so these functions can be called from any build of the scanner.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Allocation accounting, maintained when the scanner is built with `-DUNISON_SCANNER_ALLOC_STATS`.
+ */
+typedef struct {
+    uint64_t calls; // allocation calls, including reallocations
+    uint64_t bytes; // bytes currently allocated
+    uint64_t peak; // highest value of `bytes`
+} TreeSitterUnisonAllocations;
+
+/**
+ * The allocations of all scanners in the process since the library was loaded. Scanners that were destroyed no longer
+ * count towards `bytes`. The counters are plain process globals that are not updated atomically, so with parsers
+ * running on several threads at once the numbers are unreliable.
+ */
+TreeSitterUnisonAllocations tree_sitter_unison_scanner_allocations(void);
+
+/**
+ * The allocations of one scanner, for code that creates it with `tree_sitter_unison_external_scanner_create` and so
+ * has its payload, like tests and benchmarks. A `TSParser` doesn't hand out the payload of its scanner.
+ */
+TreeSitterUnisonAllocations tree_sitter_unison_external_scanner_allocations(const void *payload);
+
+/**
+ * The external symbols of the grammar, in the order of `externals` in grammar.js, as the scanner's statistics index
+ * them. `TREE_SITTER_UNISON_SYM_TOTAL` is the index of the counters of all calls.
+ */
+typedef enum {
+    TREE_SITTER_UNISON_SYM_SEMICOLON,
+    TREE_SITTER_UNISON_SYM_START,
+    TREE_SITTER_UNISON_SYM_END,
+    TREE_SITTER_UNISON_SYM_DOT,
+    TREE_SITTER_UNISON_SYM_WHERE,
+    TREE_SITTER_UNISON_SYM_VARSYM,
+    TREE_SITTER_UNISON_SYM_COMMENT,
+    TREE_SITTER_UNISON_SYM_FOLD,
+    TREE_SITTER_UNISON_SYM_COMMA,
+    TREE_SITTER_UNISON_SYM_IN,
+    TREE_SITTER_UNISON_SYM_INDENT,
+    TREE_SITTER_UNISON_SYM_EMPTY,
+    TREE_SITTER_UNISON_SYM_SYMOP,
+    TREE_SITTER_UNISON_SYM_PREFIX_SYMOP,
+    TREE_SITTER_UNISON_SYM_WATCH,
+    TREE_SITTER_UNISON_SYM_START_AND_ARROW,
+    TREE_SITTER_UNISON_SYM_OCTOTHORPE,
+    TREE_SITTER_UNISON_SYM_DOC_OPEN,
+    TREE_SITTER_UNISON_SYM_GUARD_LAYOUT_START,
+    TREE_SITTER_UNISON_SYM_DESTRUCTURE_START,
+    TREE_SITTER_UNISON_SYM_FOLD_CONTINUATION,
+    TREE_SITTER_UNISON_SYM_DOC_CLOSE,
+    TREE_SITTER_UNISON_SYM_DOC_TEXT,
+    TREE_SITTER_UNISON_SYM_NAT,
+    TREE_SITTER_UNISON_SYM_INT,
+    TREE_SITTER_UNISON_SYM_FLOAT,
+    TREE_SITTER_UNISON_SYM_HEX,
+    TREE_SITTER_UNISON_SYM_BYTES,
+    TREE_SITTER_UNISON_SYM_PATH,
+    TREE_SITTER_UNISON_SYM_TOTAL,
+    TREE_SITTER_UNISON_SYM_COUNT,
+} TreeSitterUnisonSymbol;
+
+/**
+ * Counters for one symbol, maintained when the scanner is built with `-DUNISON_SCANNER_STATS`.
+ */
+typedef struct {
+    uint64_t calls; // calls with the symbol valid
+    uint64_t successes; // calls that produced the symbol
+    uint64_t failures; // calls with the symbol valid that produced no token
+    uint64_t after_error; // calls with the symbol valid made after an error, with all symbols valid
+    uint64_t advanced; // characters advanced over by the calls that produced the symbol
+    uint64_t wasted; // characters of those advanced over past the end of the token
+    uint32_t max_indents; // deepest indent stack left behind by a call that produced the symbol
+} TreeSitterUnisonSymbolStats;
+
+/**
+ * The counters of all scanners in the process, by `TreeSitterUnisonSymbol`. The entry for
+ * `TREE_SITTER_UNISON_SYM_TOTAL` is the total: its `calls`, `failures` and `after_error` count all calls, and its
+ * characters and indents are those of the calls that produced no token, all of whose characters are wasted.
+ */
+typedef struct {
+    TreeSitterUnisonSymbolStats symbols[TREE_SITTER_UNISON_SYM_COUNT];
+} TreeSitterUnisonScannerStats;
+
+/**
+ * Read the counters of all scanners since the library was loaded or they were last reset. They are a single process
+ * global that is not updated atomically, so with parsers running on several threads at once the counts are unreliable.
+ */
+TreeSitterUnisonScannerStats tree_sitter_unison_scanner_stats(void);
+
+void tree_sitter_unison_scanner_stats_reset(void);
+
+/**
+ * Write the decision trace of the last calls of all scanners to `buffer`, if it has `size` bytes of room for it, and
+ * return its size either way, 0 unless the scanner is built with `-DUNISON_SCANNER_DECISIONS`. The format is described
+ * in scanner.c, and `script/decode-decisions.js` renders it. Like the statistics, the trace is a non-atomic process
+ * global.
+ */
+uint32_t tree_sitter_unison_decision_trace_dump(char *buffer, uint32_t size);
+
+void tree_sitter_unison_decision_trace_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TREE_SITTER_UNISON_H_